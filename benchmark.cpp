@@ -0,0 +1,99 @@
+#include "benchmark.h"
+#include "requests.h"
+#include "transport_database.h"
+
+#include <chrono>
+#include <random>
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace Transport::Benchmark {
+    namespace {
+        // Counts last-level cache misses of the calling thread; stays disabled where perf events are not allowed.
+        class CacheMissCounter {
+        public:
+            CacheMissCounter() {
+                perf_event_attr attr{};
+                attr.size = sizeof(attr);
+                attr.type = PERF_TYPE_HARDWARE;
+                attr.config = PERF_COUNT_HW_CACHE_MISSES;
+                attr.disabled = 1;
+                attr.exclude_kernel = 1;
+                attr.exclude_hv = 1;
+                fd_ = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+            }
+            CacheMissCounter(const CacheMissCounter&) = delete;
+            CacheMissCounter& operator = (const CacheMissCounter&) = delete;
+            ~CacheMissCounter() { if (fd_ >= 0) close(fd_); }
+            void Start() {
+                if (fd_ < 0) return;
+                ioctl(fd_, PERF_EVENT_IOC_RESET, 0);
+                ioctl(fd_, PERF_EVENT_IOC_ENABLE, 0);
+            }
+            std::optional<uint64_t> Stop() {
+                if (fd_ < 0) return std::nullopt;
+                ioctl(fd_, PERF_EVENT_IOC_DISABLE, 0);
+                uint64_t count = 0;
+                if (read(fd_, &count, sizeof(count)) != sizeof(count)) return std::nullopt;
+                return count;
+            }
+        private:
+            int fd_{-1};
+        };
+
+        Json::Document WithRoutingSettings(const Json::Document& base, const std::string& vertex_order) {
+            auto root = base.GetRoot().AsMap();
+            auto settings = root.at("routing_settings").AsMap();
+            settings["engine"] = std::string("dijkstra");
+            settings["route_cache_size"] = 0;
+            settings["vertex_order"] = vertex_order;
+            root["routing_settings"] = std::move(settings);
+            return Json::Document(std::move(root));
+        }
+    }
+
+    std::vector<RouteBenchmarkResult> BenchmarkVertexOrders(const Json::Document& base, size_t route_count) {
+        std::vector<StopName> stop_names;
+        for (const auto& request : base.GetRoot().AsMap().at("base_requests").AsArray()) {
+            if (request.AsMap().at("type").AsString() == "Stop") stop_names.push_back(request.AsMap().at("name").AsString());
+        }
+        if (stop_names.empty()) return {};
+        std::mt19937 generator(42);
+        std::uniform_int_distribution<size_t> stop_distribution(0, stop_names.size() - 1);
+        std::vector<std::pair<size_t, size_t>> routes(route_count);
+        for (auto& [from, to] : routes) {
+            from = stop_distribution(generator);
+            to = stop_distribution(generator);
+        }
+
+        std::vector<RouteBenchmarkResult> results;
+        for (const std::string vertex_order : {"none", "geographic"}) {
+            TransportDatabase tdb;
+            Requests::ProcessRequests(Requests::ParseBaseRequests(WithRoutingSettings(base, vertex_order)), tdb);
+            CacheMissCounter cache_misses;
+            const auto start = std::chrono::steady_clock::now();
+            cache_misses.Start();
+            for (const auto& [from, to] : routes) tdb.GetRoute(stop_names[from], stop_names[to], 0);
+            const std::optional<uint64_t> miss_count = cache_misses.Stop();
+            const std::chrono::duration<double, std::micro> duration = std::chrono::steady_clock::now() - start;
+
+            RouteBenchmarkResult& result = results.emplace_back();
+            result.vertex_order = vertex_order;
+            result.route_count = route_count;
+            result.microseconds_per_route = route_count != 0 ? duration.count() / route_count : 0;
+            if (miss_count && route_count != 0) result.cache_misses_per_route = static_cast<double>(*miss_count) / route_count;
+        }
+        return results;
+    }
+
+    std::ostream& operator << (std::ostream& output, const RouteBenchmarkResult& result) {
+        output << "vertex_order " << result.vertex_order << ": " << result.route_count << " routes, "
+               << result.microseconds_per_route << " us/route, ";
+        if (result.cache_misses_per_route) output << *result.cache_misses_per_route << " cache misses/route";
+        else output << "cache misses n/a";
+        return output;
+    }
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#ifndef CPPCOURSERA_BENCHMARK_H
+#define CPPCOURSERA_BENCHMARK_H
+
+#endif //CPPCOURSERA_BENCHMARK_H
+
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "json.h"
+
+namespace Transport::Benchmark {
+    struct RouteBenchmarkResult {
+        std::string vertex_order;
+        size_t route_count{0};
+        double microseconds_per_route{0};
+        std::optional<double> cache_misses_per_route; // empty when hardware counters are not available
+    };
+    // Builds the database of a base document once per vertex order, with the dijkstra engine and without
+    // the route cache, and answers the same random Route queries on each build.
+    std::vector<RouteBenchmarkResult> BenchmarkVertexOrders(const Json::Document& base, size_t route_count);
+    std::ostream& operator << (std::ostream& output, const RouteBenchmarkResult& result);
+}
@@ -0,0 +1,32 @@
+#include "database_snapshots.h"
+
+#include <algorithm>
+
+namespace Transport {
+    DatabaseSnapshots::DatabaseSnapshots(Snapshot initial) : current_(std::move(initial)) {}
+    DatabaseSnapshots::Snapshot DatabaseSnapshots::Acquire() const { return std::atomic_load(&current_); }
+    uint64_t DatabaseSnapshots::Publish(Snapshot snapshot) {
+        Snapshot previous = std::atomic_exchange(&current_, std::move(snapshot));
+        uint64_t version = ++version_;
+        std::lock_guard<std::mutex> guard(retired_mutex_);
+        if (previous) retired_.push_back(std::move(previous));
+        return version;
+    }
+    size_t DatabaseSnapshots::ReclaimRetired() {
+        std::vector<Snapshot> drained;
+        {
+            std::lock_guard<std::mutex> guard(retired_mutex_);
+            auto it = std::partition(retired_.begin(), retired_.end(), [](const Snapshot& snapshot) {
+                return snapshot.use_count() > 1;
+            });
+            std::move(it, retired_.end(), std::back_inserter(drained));
+            retired_.erase(it, retired_.end());
+        }
+        return drained.size(); // drained versions are destroyed here, outside of the lock
+    }
+    size_t DatabaseSnapshots::GetRetiredCount() const {
+        std::lock_guard<std::mutex> guard(retired_mutex_);
+        return retired_.size();
+    }
+    uint64_t DatabaseSnapshots::GetVersion() const { return version_; }
+}
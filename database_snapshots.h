@@ -0,0 +1,35 @@
+#pragma once
+
+#ifndef CPPCOURSERA_DATABASE_SNAPSHOTS_H
+#define CPPCOURSERA_DATABASE_SNAPSHOTS_H
+
+#endif //CPPCOURSERA_DATABASE_SNAPSHOTS_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "transport_database.h"
+
+namespace Transport {
+    // Holds the current immutable version of the database. Readers take a snapshot and finish
+    // their query on it even if a new version is published meanwhile. Old versions are not
+    // destroyed on reader threads: they are retired and freed by ReclaimRetired once drained.
+    class DatabaseSnapshots {
+    public:
+        using Snapshot = std::shared_ptr<const TransportDatabase>;
+        explicit DatabaseSnapshots(Snapshot initial);
+        Snapshot Acquire() const;
+        uint64_t Publish(Snapshot snapshot);
+        size_t ReclaimRetired();
+        size_t GetRetiredCount() const;
+        uint64_t GetVersion() const;
+    private:
+        Snapshot current_;
+        std::atomic<uint64_t> version_{1};
+        mutable std::mutex retired_mutex_;
+        std::vector<Snapshot> retired_;
+    };
+}
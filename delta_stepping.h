@@ -0,0 +1,173 @@
+#pragma once
+
+#include "graph.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <limits>
+#include <optional>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+namespace Graph {
+
+  // Parallel single-source shortest paths by delta-stepping. Reached vertices wait in buckets of width delta;
+  // the lowest bucket is settled in phases that relax the light edges (weight <= delta) of its vertices,
+  // then the heavy edges of every vertex the bucket settled are relaxed once.
+  // Each thread of a phase collects relaxations in its own buffer and the buffers are applied in thread order,
+  // so the result doesn't depend on timing. The threads are started once and serve the phases of every Run. Weights are Dijkstra's; of equal-weight paths the one with
+  // the shorter last edge is kept, as in Router.
+  template <typename Weight>
+  class DeltaStepping {
+  public:
+    DeltaStepping(const DirectedWeightedGraph<Weight>& graph, Weight delta, size_t thread_count = GetThreadCount());
+    // the mean edge weight, a bucket then takes about one edge of a path
+    static Weight ChooseDelta(const DirectedWeightedGraph<Weight>& graph);
+
+    void Run(VertexId source);
+    bool IsReached(VertexId vertex) const;
+    Weight GetWeight(VertexId vertex) const;
+    std::optional<EdgeId> GetPrevEdge(VertexId vertex) const;
+
+  private:
+    static constexpr Weight unreached = std::numeric_limits<Weight>::max();
+    static constexpr EdgeId no_edge = std::numeric_limits<EdgeId>::max();
+    // smaller frontiers are relaxed by the calling thread, waking the workers would cost more
+    static constexpr size_t min_parallel_frontier = 1024;
+    struct Relaxation {
+      VertexId vertex;
+      Weight weight;
+      EdgeId edge;
+    };
+
+    const DirectedWeightedGraph<Weight>& graph_;
+    Weight delta_;
+    size_t thread_count_;
+    std::vector<Weight> weights_;
+    std::vector<EdgeId> prev_edges_;
+    std::vector<std::vector<VertexId>> buckets_;
+    std::vector<std::vector<Relaxation>> buffers_;
+    WorkerTeam workers_;
+
+    size_t GetBucket(Weight weight) const { return static_cast<size_t>(weight / delta_); }
+    void Apply(const Relaxation& relaxation);
+    void RelaxFrontier(const std::vector<VertexId>& frontier, bool is_light);
+  };
+
+
+  template <typename Weight>
+  DeltaStepping<Weight>::DeltaStepping(const DirectedWeightedGraph<Weight>& graph, Weight delta, size_t thread_count)
+      : graph_(graph), delta_(delta), thread_count_(std::max<size_t>(thread_count, 1)), workers_(thread_count_) {
+    if (!(delta_ > 0)) {
+      throw std::invalid_argument("delta-stepping needs a positive delta");
+    }
+  }
+
+  template <typename Weight>
+  Weight DeltaStepping<Weight>::ChooseDelta(const DirectedWeightedGraph<Weight>& graph) {
+    const size_t edge_count = graph.GetEdgeCount();
+    double weight_sum = 0;
+    for (EdgeId edge_id = 0; edge_id < edge_count; ++edge_id) {
+      weight_sum += graph.GetEdge(edge_id).weight;
+    }
+    const double mean = edge_count != 0 ? weight_sum / edge_count : 0;
+    return mean >= 1 || (!std::is_integral_v<Weight> && mean > 0) ? static_cast<Weight>(mean) : Weight(1);
+  }
+
+  template <typename Weight>
+  void DeltaStepping<Weight>::Apply(const Relaxation& relaxation) {
+    Weight& weight = weights_[relaxation.vertex];
+    EdgeId& prev_edge = prev_edges_[relaxation.vertex];
+    if (relaxation.weight < weight) {
+      weight = relaxation.weight;
+      prev_edge = relaxation.edge;
+      const size_t bucket = GetBucket(weight);
+      if (bucket >= buckets_.size()) {
+        buckets_.resize(bucket + 1);
+      }
+      buckets_[bucket].push_back(relaxation.vertex);
+    } else if (relaxation.weight == weight && prev_edge != no_edge) {
+      // positive edges only: a tie through a zero-weight edge could close a cycle of predecessors
+      const Weight edge_weight = graph_.GetEdge(relaxation.edge).weight;
+      if (edge_weight > 0 && edge_weight < graph_.GetEdge(prev_edge).weight) {
+        prev_edge = relaxation.edge;
+      }
+    }
+  }
+
+  template <typename Weight>
+  void DeltaStepping<Weight>::RelaxFrontier(const std::vector<VertexId>& frontier, bool is_light) {
+    const size_t thread_count = frontier.size() >= min_parallel_frontier ? thread_count_ : 1;
+    buffers_.resize(std::max(buffers_.size(), thread_count));
+    workers_.Run(thread_count, [&](size_t thread) {
+      std::vector<Relaxation>& buffer = buffers_[thread];
+      buffer.clear();
+      const size_t begin = frontier.size() * thread / thread_count, end = frontier.size() * (thread + 1) / thread_count;
+      for (size_t i = begin; i < end; ++i) {
+        const Weight weight = weights_[frontier[i]];
+        for (EdgeId edge_id : graph_.GetIncidentEdges(frontier[i])) {
+          const auto& edge = graph_.GetEdge(edge_id);
+          if ((edge.weight <= delta_) != is_light) {
+            continue;
+          }
+          const Weight to_weight = AddWeights(weight, edge.weight);
+          if (!(weights_[edge.to] < to_weight)) {
+            buffer.push_back({edge.to, to_weight, edge_id});
+          }
+        }
+      }
+    });
+    for (size_t thread = 0; thread < thread_count; ++thread) {
+      for (const Relaxation& relaxation : buffers_[thread]) {
+        Apply(relaxation);
+      }
+    }
+  }
+
+  template <typename Weight>
+  void DeltaStepping<Weight>::Run(VertexId source) {
+    const size_t vertex_count = graph_.GetVertexCount();
+    weights_.assign(vertex_count, unreached);
+    prev_edges_.assign(vertex_count, no_edge);
+    buckets_.clear();
+    Apply({source, Weight(0), no_edge});
+    std::vector<VertexId> frontier, settled;
+    for (size_t bucket = 0; bucket < buckets_.size(); ++bucket) {
+      settled.clear();
+      while (!buckets_[bucket].empty()) {
+        frontier.swap(buckets_[bucket]);
+        buckets_[bucket].clear();
+        // entries are added on every improvement, keep the vertices whose weight is still in this bucket
+        frontier.erase(std::remove_if(frontier.begin(), frontier.end(), [&](VertexId vertex) {
+          return GetBucket(weights_[vertex]) != bucket;
+        }), frontier.end());
+        std::sort(frontier.begin(), frontier.end());
+        frontier.erase(std::unique(frontier.begin(), frontier.end()), frontier.end());
+        settled.insert(settled.end(), frontier.begin(), frontier.end());
+        RelaxFrontier(frontier, true);
+      }
+      std::sort(settled.begin(), settled.end());
+      settled.erase(std::unique(settled.begin(), settled.end()), settled.end());
+      RelaxFrontier(settled, false);
+    }
+  }
+
+  template <typename Weight>
+  bool DeltaStepping<Weight>::IsReached(VertexId vertex) const {
+    return weights_[vertex] != unreached;
+  }
+
+  template <typename Weight>
+  Weight DeltaStepping<Weight>::GetWeight(VertexId vertex) const {
+    return weights_[vertex];
+  }
+
+  template <typename Weight>
+  std::optional<EdgeId> DeltaStepping<Weight>::GetPrevEdge(VertexId vertex) const {
+    if (prev_edges_[vertex] == no_edge) {
+      return std::nullopt;
+    }
+    return prev_edges_[vertex];
+  }
+}
@@ -0,0 +1,233 @@
+#include "flat_database.h"
+#include "json_schema.h"
+#include "requests.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+namespace Transport {
+    namespace {
+        uint64_t Align(uint64_t offset) { return (offset + 7) / 8 * 8; }
+        uint32_t CheckedCount(size_t count) {
+            if (count >= UINT32_MAX) throw std::length_error("database is too large for the flat format");
+            return static_cast<uint32_t>(count);
+        }
+        void WritePadding(std::ostream& output, uint64_t& position) {
+            static const char zeros[8] = {};
+            output.write(zeros, Align(position) - position);
+            position = Align(position);
+        }
+        template <typename T>
+        void AppendRecords(std::ostream& output, uint64_t& position, const T* records, size_t count) {
+            output.write(reinterpret_cast<const char*>(records), sizeof(T) * count);
+            position += sizeof(T) * count;
+        }
+        template <typename T>
+        void WriteRecords(std::ostream& output, uint64_t& position, const T* records, size_t count) {
+            WritePadding(output, position);
+            AppendRecords(output, position, records, count);
+        }
+    }
+
+    void WriteFlatDatabase(const TransportDatabase& tdb, std::ostream& output) {
+        if (!tdb.router_) throw std::logic_error("router is not initialized (flat images need the table routing engine)");
+        std::string strings;
+        auto add_string = [&strings](std::string_view str) {
+            Flat::StringRef ref{CheckedCount(strings.size()), CheckedCount(str.size())};
+            strings.append(str);
+            CheckedCount(strings.size());
+            return ref;
+        };
+
+        std::vector<StopHandler> stops;
+        for (const auto& [_, stop] : tdb.stop_by_name_) stops.push_back(stop);
+        std::sort(stops.begin(), stops.end(), [](const StopHandler& lhs, const StopHandler& rhs) { return lhs->name < rhs->name; });
+        std::vector<BusHandler> buses;
+        for (const auto& [_, bus] : tdb.bus_by_number_) buses.push_back(bus);
+        std::sort(buses.begin(), buses.end(), [](const BusHandler& lhs, const BusHandler& rhs) { return lhs->number < rhs->number; });
+        std::unordered_map<std::string_view, uint32_t> stop_index, bus_index;
+        for (size_t i = 0; i < stops.size(); ++i) stop_index[stops[i]->name] = i;
+        for (size_t i = 0; i < buses.size(); ++i) bus_index[buses[i]->number] = i;
+
+        std::vector<Flat::BusRecord> bus_records;
+        for (const auto& bus : buses) {
+            BusRouteInfo info = bus->route.GetInfo();
+            bus_records.push_back({add_string(bus->number), CheckedCount(info.num_stops_), CheckedCount(info.num_unique_stops_),
+                                   info.road_length_, info.length_, info.curvature_});
+        }
+        std::vector<Flat::StopRecord> stop_records;
+        std::vector<uint32_t> stop_buses;
+        for (const auto& stop : stops) {
+            Flat::StopRecord record{add_string(stop->name), CheckedCount(stop_buses.size()), 0,
+                                    CheckedCount(stop->id)};
+            for (const auto& bus : stop->buses) stop_buses.push_back(bus_index.at(bus->number));
+            std::sort(stop_buses.begin() + record.buses_begin, stop_buses.end());
+            record.buses_count = stop_buses.size() - record.buses_begin;
+            stop_records.push_back(record);
+        }
+        const size_t vertex_count = tdb.graph_->GetVertexCount();
+        std::vector<Flat::VertexRecord> vertex_records(vertex_count);
+        for (size_t id = 0; id < vertex_count; ++id) {
+            const auto& vertex = tdb.vertex_by_id_.at(id);
+            vertex_records[id] = {stop_index.at(vertex.stop_name), vertex.bus ? bus_index.at(*vertex.bus) : Flat::no_bus};
+        }
+        std::vector<Flat::EdgeRecord> edge_records;
+        for (Graph::EdgeId id = 0; id < tdb.graph_->GetEdgeCount(); ++id) {
+            const auto& edge = tdb.graph_->GetEdge(id);
+            edge_records.push_back({CheckedCount(edge.from), CheckedCount(edge.to), tdb.GetEdgeTime(id)});
+        }
+        if (edge_records.size() >= Flat::route_origin) throw std::length_error("database is too large for the flat format");
+
+        Flat::Header header{};
+        std::copy(std::begin(Flat::magic), std::end(Flat::magic), header.magic);
+        header.stop_count = CheckedCount(stop_records.size());
+        header.bus_count = CheckedCount(bus_records.size());
+        header.stop_bus_count = CheckedCount(stop_buses.size());
+        header.vertex_count = CheckedCount(vertex_count);
+        header.edge_count = CheckedCount(edge_records.size());
+        header.strings_offset = sizeof(Flat::Header);
+        header.strings_size = strings.size();
+        header.stops_offset = Align(header.strings_offset + header.strings_size);
+        header.stop_buses_offset = Align(header.stops_offset + sizeof(Flat::StopRecord) * header.stop_count);
+        header.buses_offset = Align(header.stop_buses_offset + sizeof(uint32_t) * header.stop_bus_count);
+        header.vertices_offset = Align(header.buses_offset + sizeof(Flat::BusRecord) * header.bus_count);
+        header.edges_offset = Align(header.vertices_offset + sizeof(Flat::VertexRecord) * header.vertex_count);
+        header.routes_offset = Align(header.edges_offset + sizeof(Flat::EdgeRecord) * header.edge_count);
+
+        uint64_t position = 0;
+        WriteRecords(output, position, &header, 1);
+        WriteRecords(output, position, strings.data(), strings.size());
+        WriteRecords(output, position, stop_records.data(), stop_records.size());
+        WriteRecords(output, position, stop_buses.data(), stop_buses.size());
+        WriteRecords(output, position, bus_records.data(), bus_records.size());
+        WriteRecords(output, position, vertex_records.data(), vertex_records.size());
+        WriteRecords(output, position, edge_records.data(), edge_records.size());
+        // the rows form one array, so only its start is aligned
+        WritePadding(output, position);
+        std::vector<Flat::RouteRecord> row(vertex_count);
+        for (const auto& stop_record : stop_records) {
+            for (Graph::VertexId to = 0; to < vertex_count; ++to) {
+                std::optional<Graph::EdgeId> prev_edge = tdb.router_->GetRouteLastEdge(stop_record.vertex, to);
+                if (prev_edge) row[to] = {static_cast<uint32_t>(*prev_edge)};
+                else row[to] = {tdb.router_->GetRouteWeight(stop_record.vertex, to) ? Flat::route_origin : Flat::no_route};
+            }
+            AppendRecords(output, position, row.data(), row.size());
+        }
+        if (!output) throw std::runtime_error("can't write flat database");
+    }
+
+    void WriteFlatDatabase(const TransportDatabase& tdb, const std::string& path) {
+        // written aside and renamed, so attaching workers never see a half-written image
+        const std::string tmp_path = path + ".tmp";
+        {
+            std::ofstream output(tmp_path, std::ios::binary | std::ios::trunc);
+            WriteFlatDatabase(tdb, output);
+        }
+        if (std::rename(tmp_path.c_str(), path.c_str()) != 0) throw std::runtime_error("can't rename " + tmp_path);
+    }
+
+    FlatDatabaseView::FlatDatabaseView(std::string_view data) : data_(data) {
+        if (data_.size() < sizeof(Flat::Header) || std::memcmp(data_.data(), Flat::magic, sizeof(Flat::magic)) != 0)
+            throw std::invalid_argument("not a flat database image");
+        if (reinterpret_cast<uintptr_t>(data_.data()) % alignof(Flat::Header) != 0)
+            throw std::invalid_argument("flat database image is not aligned");
+        header_ = reinterpret_cast<const Flat::Header*>(data_.data());
+        auto check_range = [this](uint64_t offset, uint64_t count, uint64_t record_size) {
+            if (offset % 8 != 0 || offset > data_.size() || count > (data_.size() - offset) / record_size)
+                throw std::invalid_argument("flat database image is truncated");
+        };
+        check_range(header_->strings_offset, header_->strings_size, 1);
+        check_range(header_->stops_offset, header_->stop_count, sizeof(Flat::StopRecord));
+        check_range(header_->stop_buses_offset, header_->stop_bus_count, sizeof(uint32_t));
+        check_range(header_->buses_offset, header_->bus_count, sizeof(Flat::BusRecord));
+        check_range(header_->vertices_offset, header_->vertex_count, sizeof(Flat::VertexRecord));
+        check_range(header_->edges_offset, header_->edge_count, sizeof(Flat::EdgeRecord));
+        const uint64_t route_count = uint64_t{header_->stop_count} * header_->vertex_count;
+        check_range(header_->routes_offset, route_count, sizeof(Flat::RouteRecord));
+        if (header_->routes_offset + route_count * sizeof(Flat::RouteRecord) != data_.size())
+            throw std::invalid_argument("flat database image is truncated");
+        stops_ = reinterpret_cast<const Flat::StopRecord*>(data_.data() + header_->stops_offset);
+        stop_buses_ = reinterpret_cast<const uint32_t*>(data_.data() + header_->stop_buses_offset);
+        buses_ = reinterpret_cast<const Flat::BusRecord*>(data_.data() + header_->buses_offset);
+        vertices_ = reinterpret_cast<const Flat::VertexRecord*>(data_.data() + header_->vertices_offset);
+        edges_ = reinterpret_cast<const Flat::EdgeRecord*>(data_.data() + header_->edges_offset);
+        routes_ = reinterpret_cast<const Flat::RouteRecord*>(data_.data() + header_->routes_offset);
+    }
+    std::string_view FlatDatabaseView::GetString(Flat::StringRef ref) const {
+        return data_.substr(header_->strings_offset + ref.offset, ref.size);
+    }
+    const Flat::StopRecord* FlatDatabaseView::FindStop(std::string_view name) const {
+        const Flat::StopRecord* end = stops_ + header_->stop_count;
+        const Flat::StopRecord* it = std::lower_bound(stops_, end, name, [this](const Flat::StopRecord& record, std::string_view value) {
+            return GetString(record.name) < value;
+        });
+        return it != end && GetString(it->name) == name ? it : nullptr;
+    }
+    const Flat::BusRecord* FlatDatabaseView::FindBus(std::string_view number) const {
+        const Flat::BusRecord* end = buses_ + header_->bus_count;
+        const Flat::BusRecord* it = std::lower_bound(buses_, end, number, [this](const Flat::BusRecord& record, std::string_view value) {
+            return GetString(record.number) < value;
+        });
+        return it != end && GetString(it->number) == number ? it : nullptr;
+    }
+    Json::Node FlatDatabaseView::GetBus(const BusNumber& number, size_t request_id) const {
+        const Flat::BusRecord* bus = FindBus(number);
+        if (!bus) return NodeNotFound(request_id);
+        BusRouteInfo info{bus->stop_count, bus->unique_stop_count, bus->length, bus->curvature, bus->route_length};
+        return NodeFromBusRouteInfo(info, request_id);
+    }
+    Json::Node FlatDatabaseView::GetStop(const StopName& name, size_t request_id) const {
+        const Flat::StopRecord* stop = FindStop(name);
+        if (!stop) return NodeNotFound(request_id);
+        std::vector<Json::Node> buses;
+        for (uint32_t i = stop->buses_begin; i < stop->buses_begin + stop->buses_count; ++i) {
+            buses.emplace_back(std::string(GetString(buses_[stop_buses_[i]].number)));
+        }
+        return std::map<std::string, Json::Node> {{"request_id", static_cast<int>(request_id)}, {"buses", std::move(buses)}};
+    }
+    Json::Node FlatDatabaseView::GetRoute(const StopName& from, const StopName& to, size_t request_id) const {
+        const Flat::StopRecord* stop_from = FindStop(from);
+        const Flat::StopRecord* stop_to = FindStop(to);
+        if (!stop_from || !stop_to) return NodeNotFound(request_id);
+        const Flat::RouteRecord* row = routes_ + uint64_t(stop_from - stops_) * header_->vertex_count;
+        if (row[stop_to->vertex].prev_edge == Flat::no_route) return NodeNotFound(request_id);
+        std::vector<uint32_t> route_edges;
+        for (uint32_t edge_id = row[stop_to->vertex].prev_edge; edge_id != Flat::route_origin; edge_id = row[edges_[edge_id].from].prev_edge) {
+            if (edge_id >= header_->edge_count) throw std::invalid_argument("flat database image has a broken route");
+            route_edges.push_back(edge_id);
+        }
+        RouteResponseBuilder builder;
+        for (auto it = route_edges.rbegin(); it != route_edges.rend(); ++it) {
+            const Flat::EdgeRecord& edge = edges_[*it];
+            const Flat::VertexRecord& vertex_from = vertices_[edge.from], vertex_to = vertices_[edge.to];
+            std::optional<std::string_view> bus_to;
+            if (vertex_to.bus != Flat::no_bus) bus_to = GetString(buses_[vertex_to.bus].number);
+            builder.AddEdge(edge.weight, GetString(stops_[vertex_from.stop].name), bus_to);
+        }
+        return NodeFromRouteResponse(std::move(builder).Build(), request_id);
+    }
+
+    Json::Document ProcessStatRequests(const Json::Document& document, const FlatDatabaseView& view) {
+        std::vector<Json::Node> request_results;
+        const auto& requests = document.GetRoot().AsMap().at("stat_requests").AsArray();
+        for (size_t i = 0; i < requests.size(); ++i) {
+            Requests::StatRequest request;
+            Json::DecodeField("stat_requests[" + std::to_string(i) + "]", [&] {
+                request = Requests::ParseStatRequest(requests[i]);
+            });
+            if (const auto* bus = std::get_if<Requests::GetBusRequest>(&request)) {
+                request_results.push_back(view.GetBus(bus->bus_number, bus->id));
+            } else if (const auto* stop = std::get_if<Requests::GetStopRequest>(&request)) {
+                request_results.push_back(view.GetStop(stop->stop_name, stop->id));
+            } else if (const auto* route = std::get_if<Requests::GetRouteRequest>(&request)) {
+                request_results.push_back(view.GetRoute(route->from, route->to, route->id));
+            } else {
+                throw std::invalid_argument("unsupported type of request for a flat database");
+            }
+        }
+        return Json::Document(Json::Node(request_results));
+    }
+}
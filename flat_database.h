@@ -0,0 +1,79 @@
+#pragma once
+
+#ifndef CPPCOURSERA_FLAT_DATABASE_H
+#define CPPCOURSERA_FLAT_DATABASE_H
+
+#endif //CPPCOURSERA_FLAT_DATABASE_H
+
+#include <cstdint>
+#include <iostream>
+#include <string_view>
+
+#include "transport_database.h"
+#include "json.h"
+
+namespace Transport {
+    // Position-independent image of a built database: all references are offsets from the start of
+    // the image, so one builder can write it to a file and any number of processes can map it read-only.
+    namespace Flat {
+        constexpr char magic[8] = {'T', 'D', 'B', 'F', 'L', 'A', 'T', '2'};
+        constexpr uint32_t no_bus = UINT32_MAX;
+        // the prev_edge of a route record that isn't an edge: no route, or the origin's own entry
+        constexpr uint32_t no_route = UINT32_MAX;
+        constexpr uint32_t route_origin = UINT32_MAX - 1;
+        struct StringRef {
+            uint32_t offset, size;
+        };
+        struct Header {
+            char magic[8];
+            uint32_t stop_count, bus_count, stop_bus_count, vertex_count;
+            uint64_t edge_count;
+            uint64_t strings_offset, strings_size;
+            uint64_t stops_offset, stop_buses_offset, buses_offset, vertices_offset, edges_offset, routes_offset;
+        };
+        struct StopRecord {
+            StringRef name;
+            uint32_t buses_begin, buses_count;
+            uint32_t vertex;
+        };
+        struct BusRecord {
+            StringRef number;
+            uint32_t stop_count, unique_stop_count;
+            uint64_t route_length;
+            double length, curvature;
+        };
+        struct VertexRecord {
+            uint32_t stop, bus;
+        };
+        struct EdgeRecord {
+            uint32_t from, to;
+            double weight;
+        };
+        // one row per stop (in stops order), one column per vertex; routes are summed from edge weights
+        struct RouteRecord {
+            uint32_t prev_edge;
+        };
+    }
+    void WriteFlatDatabase(const TransportDatabase& tdb, std::ostream& output);
+    void WriteFlatDatabase(const TransportDatabase& tdb, const std::string& path);
+    class FlatDatabaseView {
+    public:
+        explicit FlatDatabaseView(std::string_view data);
+        Json::Node GetBus(const BusNumber& number, size_t request_id) const;
+        Json::Node GetStop(const StopName& name, size_t request_id) const;
+        Json::Node GetRoute(const StopName& from, const StopName& to, size_t request_id) const;
+    private:
+        std::string_view data_;
+        const Flat::Header* header_;
+        const Flat::StopRecord* stops_;
+        const uint32_t* stop_buses_;
+        const Flat::BusRecord* buses_;
+        const Flat::VertexRecord* vertices_;
+        const Flat::EdgeRecord* edges_;
+        const Flat::RouteRecord* routes_;
+        std::string_view GetString(Flat::StringRef ref) const;
+        const Flat::StopRecord* FindStop(std::string_view name) const;
+        const Flat::BusRecord* FindBus(std::string_view number) const;
+    };
+    Json::Document ProcessStatRequests(const Json::Document& document, const FlatDatabaseView& view);
+}
@@ -1,7 +1,11 @@
 #pragma once
 
+#include <cstdint>
 #include <cstdlib>
 #include <deque>
+#include <limits>
+#include <stdexcept>
+#include <type_traits>
 #include <vector>
 
 template <typename It>
@@ -20,8 +24,25 @@ private:
 
 namespace Graph {
 
-  using VertexId = size_t;
-  using EdgeId = size_t;
+  using VertexId = uint32_t;
+  using EdgeId = uint32_t;
+
+  // sum of route weights; integer weights are checked for overflow
+  template <typename Weight>
+  Weight AddWeights(Weight lhs, Weight rhs) {
+    if constexpr (std::is_integral_v<Weight>) {
+      if (rhs > std::numeric_limits<Weight>::max() - lhs) {
+        throw std::overflow_error("route weight overflow");
+      }
+    }
+    return lhs + rhs;
+  }
+
+  inline void CheckIdCount(size_t count) {
+    if (count > std::numeric_limits<uint32_t>::max()) {
+      throw std::overflow_error("graph is too large for 32-bit vertex and edge ids");
+    }
+  }
 
   template <typename Weight>
   struct Edge {
@@ -38,13 +59,20 @@ namespace Graph {
 
   public:
     DirectedWeightedGraph(size_t vertex_count);
+    // pre-sized graph: edges are written concurrently by SetEdge, then BuildIncidenceLists is called once
+    DirectedWeightedGraph(size_t vertex_count, size_t edge_count);
     EdgeId AddEdge(const Edge<Weight>& edge);
+    void SetEdge(EdgeId edge_id, const Edge<Weight>& edge);
+    void BuildIncidenceLists();
 
     size_t GetVertexCount() const;
     size_t GetEdgeCount() const;
     const Edge<Weight>& GetEdge(EdgeId edge_id) const;
     IncidentEdgesRange GetIncidentEdges(VertexId vertex) const;
 
+    size_t GetEdgesMemoryUsage() const;
+    size_t GetIncidenceListsMemoryUsage() const;
+
   private:
     std::vector<Edge<Weight>> edges_;
     std::vector<IncidenceList> incidence_lists_;
@@ -52,10 +80,36 @@ namespace Graph {
 
 
   template <typename Weight>
-  DirectedWeightedGraph<Weight>::DirectedWeightedGraph(size_t vertex_count) : incidence_lists_(vertex_count) {}
+  DirectedWeightedGraph<Weight>::DirectedWeightedGraph(size_t vertex_count) : incidence_lists_(vertex_count) {
+    CheckIdCount(vertex_count);
+  }
+
+  template <typename Weight>
+  DirectedWeightedGraph<Weight>::DirectedWeightedGraph(size_t vertex_count, size_t edge_count)
+      : edges_(edge_count), incidence_lists_(vertex_count) {
+    CheckIdCount(vertex_count);
+    CheckIdCount(edge_count);
+  }
+
+  template <typename Weight>
+  void DirectedWeightedGraph<Weight>::SetEdge(EdgeId edge_id, const Edge<Weight>& edge) {
+    edges_[edge_id] = edge;
+  }
+
+  template <typename Weight>
+  void DirectedWeightedGraph<Weight>::BuildIncidenceLists() {
+    std::vector<size_t> degrees(incidence_lists_.size());
+    for (const auto& edge : edges_) ++degrees[edge.from];
+    for (VertexId vertex = 0; vertex < incidence_lists_.size(); ++vertex) {
+      incidence_lists_[vertex].clear();
+      incidence_lists_[vertex].reserve(degrees[vertex]);
+    }
+    for (EdgeId id = 0; id < edges_.size(); ++id) incidence_lists_[edges_[id].from].push_back(id);
+  }
 
   template <typename Weight>
   EdgeId DirectedWeightedGraph<Weight>::AddEdge(const Edge<Weight>& edge) {
+    CheckIdCount(edges_.size() + 1);
     edges_.push_back(edge);
     const EdgeId id = edges_.size() - 1;
     incidence_lists_[edge.from].push_back(id);
@@ -83,4 +137,18 @@ namespace Graph {
     const auto& edges = incidence_lists_[vertex];
     return {std::begin(edges), std::end(edges)};
   }
+
+  template <typename Weight>
+  size_t DirectedWeightedGraph<Weight>::GetEdgesMemoryUsage() const {
+    return edges_.capacity() * sizeof(Edge<Weight>);
+  }
+
+  template <typename Weight>
+  size_t DirectedWeightedGraph<Weight>::GetIncidenceListsMemoryUsage() const {
+    size_t result = incidence_lists_.capacity() * sizeof(IncidenceList);
+    for (const auto& incidence_list : incidence_lists_) {
+      result += incidence_list.capacity() * sizeof(EdgeId);
+    }
+    return result;
+  }
 }
@@ -0,0 +1,146 @@
+#pragma once
+
+#include "graph.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <utility>
+#include <vector>
+
+namespace Graph {
+
+  // One-to-many Dijkstra over a DirectedWeightedGraph with reusable scratch arrays.
+  // Start bumps an epoch instead of clearing the arrays, so a search touches only the vertices it reaches.
+  // Several sources with initial weights may be added, which gives a multi-source search.
+  // Of equal-weight paths to an unsettled vertex the one with the shorter last edge is kept, as in Router.
+  template <typename Weight>
+  class DijkstraSearch {
+  public:
+    void Start(size_t vertex_count);
+    void AddSource(VertexId vertex, Weight weight);
+    // settles vertices in order of weight; stops when visitor(vertex, weight) returns false
+    template <typename Visitor>
+    void Run(const DirectedWeightedGraph<Weight>& graph, Visitor visitor);
+    // A*: settles vertices in order of weight + potential(vertex), the potential must be consistent
+    template <typename Visitor, typename Potential>
+    void Run(const DirectedWeightedGraph<Weight>& graph, Visitor visitor, Potential potential);
+
+    bool IsReached(VertexId vertex) const;
+    Weight GetWeight(VertexId vertex) const;
+    std::optional<EdgeId> GetPrevEdge(VertexId vertex) const;
+    size_t GetSettledCount() const;
+
+  private:
+    struct VertexData {
+      Weight weight;
+      std::optional<EdgeId> prev_edge;
+      bool is_settled;
+    };
+    using QueueItem = std::pair<Weight, VertexId>;
+
+    uint32_t epoch_ = 0;
+    std::vector<uint32_t> epochs_;
+    std::vector<VertexData> vertexes_;
+    std::vector<QueueItem> queue_;
+    size_t settled_count_ = 0;
+
+    void Relax(VertexId vertex, Weight weight, std::optional<EdgeId> prev_edge, Weight key);
+    void RelaxEdge(const DirectedWeightedGraph<Weight>& graph, EdgeId edge_id, Weight weight, Weight key);
+  };
+
+
+  template <typename Weight>
+  void DijkstraSearch<Weight>::Start(size_t vertex_count) {
+    if (epochs_.size() != vertex_count || ++epoch_ == 0) {
+      epochs_.assign(vertex_count, 0);
+      vertexes_.resize(vertex_count);
+      epoch_ = 1;
+    }
+    queue_.clear();
+    settled_count_ = 0;
+  }
+
+  template <typename Weight>
+  void DijkstraSearch<Weight>::Relax(VertexId vertex, Weight weight, std::optional<EdgeId> prev_edge, Weight key) {
+    if (epochs_[vertex] == epoch_ && !(weight < vertexes_[vertex].weight)) {
+      return;
+    }
+    epochs_[vertex] = epoch_;
+    vertexes_[vertex] = {weight, prev_edge, false};
+    queue_.emplace_back(key, vertex);
+    std::push_heap(queue_.begin(), queue_.end(), std::greater<QueueItem>());
+  }
+
+  template <typename Weight>
+  void DijkstraSearch<Weight>::RelaxEdge(const DirectedWeightedGraph<Weight>& graph, EdgeId edge_id, Weight weight, Weight key) {
+    const auto& edge = graph.GetEdge(edge_id);
+    if (auto& data = vertexes_[edge.to]; epochs_[edge.to] == epoch_ && weight == data.weight) {
+      if (!data.is_settled && data.prev_edge && edge.weight < graph.GetEdge(*data.prev_edge).weight) {
+        data.prev_edge = edge_id;
+      }
+      return;
+    }
+    Relax(edge.to, weight, edge_id, key);
+  }
+
+  template <typename Weight>
+  void DijkstraSearch<Weight>::AddSource(VertexId vertex, Weight weight) {
+    Relax(vertex, weight, std::nullopt, weight);
+  }
+
+  template <typename Weight>
+  template <typename Visitor>
+  void DijkstraSearch<Weight>::Run(const DirectedWeightedGraph<Weight>& graph, Visitor visitor) {
+    Run(graph, visitor, [](VertexId) { return Weight(0); });
+  }
+
+  template <typename Weight>
+  template <typename Visitor, typename Potential>
+  void DijkstraSearch<Weight>::Run(const DirectedWeightedGraph<Weight>& graph, Visitor visitor, Potential potential) {
+    for (auto& [key, vertex] : queue_) {
+      key = AddWeights(vertexes_[vertex].weight, potential(vertex));
+    }
+    std::make_heap(queue_.begin(), queue_.end(), std::greater<QueueItem>());
+    while (!queue_.empty()) {
+      std::pop_heap(queue_.begin(), queue_.end(), std::greater<QueueItem>());
+      const auto [key, vertex] = queue_.back();
+      queue_.pop_back();
+      const Weight weight = vertexes_[vertex].weight;
+      if (AddWeights(weight, potential(vertex)) < key || vertexes_[vertex].is_settled) {
+        continue;
+      }
+      vertexes_[vertex].is_settled = true;
+      ++settled_count_;
+      if (!visitor(vertex, weight)) {
+        return;
+      }
+      for (EdgeId edge_id : graph.GetIncidentEdges(vertex)) {
+        const auto& edge = graph.GetEdge(edge_id);
+        const Weight to_weight = AddWeights(weight, edge.weight);
+        RelaxEdge(graph, edge_id, to_weight, AddWeights(to_weight, potential(edge.to)));
+      }
+    }
+  }
+
+  template <typename Weight>
+  bool DijkstraSearch<Weight>::IsReached(VertexId vertex) const {
+    return epochs_[vertex] == epoch_;
+  }
+
+  template <typename Weight>
+  Weight DijkstraSearch<Weight>::GetWeight(VertexId vertex) const {
+    return vertexes_[vertex].weight;
+  }
+
+  template <typename Weight>
+  std::optional<EdgeId> DijkstraSearch<Weight>::GetPrevEdge(VertexId vertex) const {
+    return vertexes_[vertex].prev_edge;
+  }
+
+  template <typename Weight>
+  size_t DijkstraSearch<Weight>::GetSettledCount() const {
+    return settled_count_;
+  }
+}
@@ -0,0 +1,226 @@
+#pragma once
+
+#include "graph.h"
+#include "memory_usage.h"
+
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <numeric>
+#include <optional>
+#include <utility>
+#include <vector>
+
+namespace Graph {
+
+  // Hub labels built by pruned landmark labeling: every vertex keeps the distances to (forward labels)
+  // and from (backward labels) a few hubs, so that some shortest path from u to v passes a hub of both.
+  // A distance is then a merge-join of two label arrays sorted by hub rank.
+  // Hubs are taken in order of vertex degree; the search from a hub stops at vertices whose distance
+  // the labels of the earlier hubs already give. Each entry also keeps the edge towards its hub,
+  // which is how paths are expanded.
+  template <typename Weight>
+  class HubLabels {
+  public:
+    HubLabels() = default;
+    explicit HubLabels(const DirectedWeightedGraph<Weight>& graph);
+
+    std::optional<Weight> GetWeight(VertexId from, VertexId to) const;
+    // edges of a shortest path in travel order
+    std::optional<std::vector<EdgeId>> GetPath(VertexId from, VertexId to) const;
+    size_t GetEntryCount() const;
+    size_t GetMemoryUsage() const;
+
+  private:
+    static constexpr Weight unreachable = std::numeric_limits<Weight>::max();
+    static constexpr EdgeId no_edge = std::numeric_limits<EdgeId>::max();
+    struct Entry {
+      uint32_t hub; // rank of the hub
+      Weight weight;
+    };
+    // the labels of all vertices in one array; edges[i] goes from the vertex towards the hub of entries[i]
+    // in forward labels and into the vertex from the hub in backward labels
+    struct Labels {
+      std::vector<size_t> offsets;
+      std::vector<Entry> entries;
+      std::vector<EdgeId> edges;
+    };
+
+    const DirectedWeightedGraph<Weight>* graph_ = nullptr;
+    std::vector<VertexId> vertex_by_rank_;
+    Labels forward_, backward_;
+
+    struct BestHub {
+      Weight weight;
+      size_t forward_index, backward_index;
+    };
+    std::optional<BestHub> FindBestHub(VertexId from, VertexId to) const;
+    static size_t FindEntry(const Labels& labels, VertexId vertex, uint32_t hub);
+  };
+
+
+  template <typename Weight>
+  HubLabels<Weight>::HubLabels(const DirectedWeightedGraph<Weight>& graph) : graph_(&graph) {
+    const size_t vertex_count = graph.GetVertexCount();
+    DirectedWeightedGraph<Weight> reversed_graph(vertex_count, graph.GetEdgeCount());
+    std::vector<size_t> degrees(vertex_count);
+    for (EdgeId edge_id = 0; edge_id < graph.GetEdgeCount(); ++edge_id) {
+      const auto& edge = graph.GetEdge(edge_id);
+      reversed_graph.SetEdge(edge_id, {edge.to, edge.from, edge.weight});
+      ++degrees[edge.from];
+      ++degrees[edge.to];
+    }
+    reversed_graph.BuildIncidenceLists();
+    vertex_by_rank_.resize(vertex_count);
+    std::iota(vertex_by_rank_.begin(), vertex_by_rank_.end(), 0);
+    std::stable_sort(vertex_by_rank_.begin(), vertex_by_rank_.end(), [&degrees](VertexId lhs, VertexId rhs) {
+      return degrees[lhs] > degrees[rhs];
+    });
+
+    using BuildLabel = std::vector<std::pair<Entry, EdgeId>>;
+    std::vector<BuildLabel> forward(vertex_count), backward(vertex_count);
+    std::vector<Weight> hub_weights(vertex_count, unreachable), weights(vertex_count, unreachable);
+    std::vector<VertexId> reached;
+    using QueueItem = std::pair<Weight, VertexId>;
+    std::vector<QueueItem> queue;
+    std::vector<EdgeId> prev_edges(vertex_count, no_edge);
+
+    // labels_to_fill get an entry for every vertex the search from the hub settles and doesn't prune;
+    // hub_labels are the opposite labels of the hub, loaded into hub_weights for the pruning queries
+    auto pruned_search = [&](uint32_t rank, const DirectedWeightedGraph<Weight>& search_graph,
+                             std::vector<BuildLabel>& labels_to_fill, const BuildLabel& hub_labels) {
+      for (const auto& [entry, _] : hub_labels) hub_weights[entry.hub] = entry.weight;
+      const VertexId hub = vertex_by_rank_[rank];
+      weights[hub] = 0;
+      reached.push_back(hub);
+      queue.emplace_back(0, hub);
+      while (!queue.empty()) {
+        std::pop_heap(queue.begin(), queue.end(), std::greater<QueueItem>());
+        const auto [weight, vertex] = queue.back();
+        queue.pop_back();
+        if (weights[vertex] < weight) continue;
+        bool is_covered = false;
+        for (const auto& [entry, _] : labels_to_fill[vertex]) {
+          if (hub_weights[entry.hub] != unreachable && hub_weights[entry.hub] <= weight &&
+              entry.weight <= weight - hub_weights[entry.hub]) {
+            is_covered = true;
+            break;
+          }
+        }
+        if (is_covered) continue;
+        labels_to_fill[vertex].push_back({{rank, weight}, prev_edges[vertex]});
+        for (EdgeId edge_id : search_graph.GetIncidentEdges(vertex)) {
+          const auto& edge = search_graph.GetEdge(edge_id);
+          const Weight to_weight = AddWeights(weight, edge.weight);
+          if (to_weight < weights[edge.to]) {
+            if (weights[edge.to] == unreachable) reached.push_back(edge.to);
+            weights[edge.to] = to_weight;
+            prev_edges[edge.to] = edge_id;
+            queue.emplace_back(to_weight, edge.to);
+            std::push_heap(queue.begin(), queue.end(), std::greater<QueueItem>());
+          }
+        }
+      }
+      for (VertexId vertex : reached) {
+        weights[vertex] = unreachable;
+        prev_edges[vertex] = no_edge;
+      }
+      reached.clear();
+      for (const auto& [entry, _] : hub_labels) hub_weights[entry.hub] = unreachable;
+    };
+    for (uint32_t rank = 0; rank < vertex_count; ++rank) {
+      const VertexId hub = vertex_by_rank_[rank];
+      pruned_search(rank, graph, backward, forward[hub]);
+      pruned_search(rank, reversed_graph, forward, backward[hub]);
+    }
+
+    for (auto [labels, build_labels] : {std::pair(&forward_, &forward), std::pair(&backward_, &backward)}) {
+      labels->offsets.reserve(vertex_count + 1);
+      labels->offsets.push_back(0);
+      for (const BuildLabel& label : *build_labels) {
+        for (const auto& [entry, edge_id] : label) {
+          labels->entries.push_back(entry);
+          labels->edges.push_back(edge_id);
+        }
+        labels->offsets.push_back(labels->entries.size());
+      }
+    }
+  }
+
+  template <typename Weight>
+  std::optional<typename HubLabels<Weight>::BestHub> HubLabels<Weight>::FindBestHub(VertexId from, VertexId to) const {
+    std::optional<BestHub> result;
+    size_t i = forward_.offsets[from], j = backward_.offsets[to];
+    const size_t forward_end = forward_.offsets[from + 1], backward_end = backward_.offsets[to + 1];
+    while (i < forward_end && j < backward_end) {
+      const Entry& forward_entry = forward_.entries[i];
+      const Entry& backward_entry = backward_.entries[j];
+      if (forward_entry.hub < backward_entry.hub) {
+        ++i;
+      } else if (backward_entry.hub < forward_entry.hub) {
+        ++j;
+      } else {
+        const Weight weight = AddWeights(forward_entry.weight, backward_entry.weight);
+        if (!result || weight < result->weight) {
+          result = BestHub{weight, i, j};
+        }
+        ++i;
+        ++j;
+      }
+    }
+    return result;
+  }
+
+  template <typename Weight>
+  std::optional<Weight> HubLabels<Weight>::GetWeight(VertexId from, VertexId to) const {
+    if (auto best_hub = FindBestHub(from, to)) {
+      return best_hub->weight;
+    }
+    return std::nullopt;
+  }
+
+  template <typename Weight>
+  size_t HubLabels<Weight>::FindEntry(const Labels& labels, VertexId vertex, uint32_t hub) {
+    const auto begin = labels.entries.begin() + labels.offsets[vertex], end = labels.entries.begin() + labels.offsets[vertex + 1];
+    return std::lower_bound(begin, end, hub, [](const Entry& entry, uint32_t rank) { return entry.hub < rank; }) -
+           labels.entries.begin();
+  }
+
+  template <typename Weight>
+  std::optional<std::vector<EdgeId>> HubLabels<Weight>::GetPath(VertexId from, VertexId to) const {
+    const auto best_hub = FindBestHub(from, to);
+    if (!best_hub) {
+      return std::nullopt;
+    }
+    // every vertex on the search tree path to or from a hub was labeled with that hub
+    const uint32_t hub = forward_.entries[best_hub->forward_index].hub;
+    std::vector<EdgeId> edges;
+    for (size_t index = best_hub->forward_index; forward_.edges[index] != no_edge; ) {
+      const EdgeId edge_id = forward_.edges[index];
+      edges.push_back(edge_id);
+      index = FindEntry(forward_, graph_->GetEdge(edge_id).to, hub);
+    }
+    const size_t forward_edge_count = edges.size();
+    for (size_t index = best_hub->backward_index; backward_.edges[index] != no_edge; ) {
+      const EdgeId edge_id = backward_.edges[index];
+      edges.push_back(edge_id);
+      index = FindEntry(backward_, graph_->GetEdge(edge_id).from, hub);
+    }
+    std::reverse(edges.begin() + forward_edge_count, edges.end());
+    return edges;
+  }
+
+  template <typename Weight>
+  size_t HubLabels<Weight>::GetEntryCount() const {
+    return forward_.entries.size() + backward_.entries.size();
+  }
+
+  template <typename Weight>
+  size_t HubLabels<Weight>::GetMemoryUsage() const {
+    size_t result = Memory::HeapBytes(vertex_by_rank_);
+    for (const Labels* labels : {&forward_, &backward_}) {
+      result += Memory::HeapBytes(labels->offsets) + Memory::HeapBytes(labels->entries) + Memory::HeapBytes(labels->edges);
+    }
+    return result;
+  }
+}
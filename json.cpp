@@ -1,6 +1,12 @@
 #include "json.h"
+#include "mapped_file.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cstdio>
 #include <cmath>
 #include <iomanip>
+#include <limits>
 
 using namespace std;
 
@@ -35,12 +41,47 @@ namespace Json {
             output << node.AsInt();
         } else if (holds_alternative<double>(node)) {
             output << setprecision(6) << node.AsDouble();
+        } else if (node.IsNull()) {
+            output << "null";
         } else {
             throw runtime_error("invalid type of node");
         }
         return output;
     }
 
+    static void PrintCompact(const Node& node, ostream& output, int precision) {
+        if (node.HoldsArray()) {
+            output << '[';
+            const vector<Node>& v = node.AsArray();
+            for (auto it = v.cbegin(); it != v.cend(); ++it) {
+                if (it != v.cbegin()) output << ',';
+                PrintCompact(*it, output, precision);
+            }
+            output << ']';
+        } else if (node.HoldsMap()) {
+            output << '{';
+            const map<string, Node>& m = node.AsMap();
+            for (auto it = m.cbegin(); it != m.cend(); ++it) {
+                if (it != m.cbegin()) output << ',';
+                output << "\"" << it->first << "\":";
+                PrintCompact(it->second, output, precision);
+            }
+            output << '}';
+        } else if (node.HoldsDouble()) {
+            output << setprecision(precision) << node.AsDouble();
+        } else {
+            output << node;
+        }
+    }
+
+    void PrintCompact(const Node& node, ostream& output) {
+        PrintCompact(node, output, 6);
+    }
+
+    void PrintExact(const Node& node, ostream& output) {
+        PrintCompact(node, output, numeric_limits<double>::max_digits10);
+    }
+
   Document::Document(Node root) : root(move(root)) {
   }
 
@@ -48,106 +89,187 @@ namespace Json {
     return root;
   }
 
-  Node LoadNode(istream& input);
+  namespace {
+    // Sources for the parser: a memory range (the fast path) and a stream, which is read
+    // exactly up to the end of the document so that the rest of it stays available.
+    class MemoryInput {
+    public:
+      explicit MemoryInput(string_view data) : pos_(data.data()), end_(data.data() + data.size()) {}
+      int Peek() const { return pos_ != end_ ? static_cast<unsigned char>(*pos_) : EOF; }
+      int Get() { return pos_ != end_ ? static_cast<unsigned char>(*pos_++) : EOF; }
+      void Ignore(size_t count) { pos_ += min<size_t>(count, end_ - pos_); }
+      void PutBack() { --pos_; }
+      bool ReadNonSpace(char& c) {
+        while (pos_ != end_ && isspace(static_cast<unsigned char>(*pos_))) ++pos_;
+        if (pos_ == end_) return false;
+        c = *pos_++;
+        return true;
+      }
+      string ReadUntil(char delimiter) {
+        const char* found = find(pos_, end_, delimiter);
+        string result(pos_, found);
+        pos_ = found != end_ ? found + 1 : end_;
+        return result;
+      }
+    private:
+      const char* pos_;
+      const char* end_;
+    };
+
+    class StreamInput {
+    public:
+      explicit StreamInput(istream& input) : input_(input) {}
+      int Peek() const { return input_.peek(); }
+      int Get() { return input_.get(); }
+      void Ignore(size_t count) { input_.ignore(count); }
+      void PutBack() { input_.unget(); }
+      bool ReadNonSpace(char& c) { return static_cast<bool>(input_ >> c); }
+      string ReadUntil(char delimiter) {
+        string result;
+        getline(input_, result, delimiter);
+        return result;
+      }
+    private:
+      istream& input_;
+    };
+
+    template <typename Input>
+    Node LoadNode(Input& input);
 
-  Node LoadArray(istream& input) {
-    vector<Node> result;
+    template <typename Input>
+    Node LoadArray(Input& input) {
+      vector<Node> result;
 
-    for (char c; input >> c && c != ']'; ) {
-      if (c != ',') {
-        input.putback(c);
+      for (char c; input.ReadNonSpace(c) && c != ']'; ) {
+        if (c != ',') {
+          input.PutBack();
+        }
+        result.push_back(LoadNode(input));
       }
-      result.push_back(LoadNode(input));
-    }
 
-    return Node(move(result));
-  }
+      return Node(move(result));
+    }
 
-  Node LoadBool(istream& input) {
+    template <typename Input>
+    Node LoadBool(Input& input) {
       bool result = false;
-      if (input.peek() == 'f') {
-          input.ignore(5);
+      if (input.Peek() == 'f') {
+        input.Ignore(5);
       } else {
-          result = true;
-          input.ignore(4);
+        result = true;
+        input.Ignore(4);
       }
       return result;
-  }
-
-  Node LoadInt(istream& input) {
-    int result = 0;
-    while (isdigit(input.peek())) {
-      result *= 10;
-      result += input.get() - '0';
     }
-    return Node(result);
-  }
 
-  Node LoadNumber(istream& input) {
-      bool is_positive = true;
-      if (input.peek() == '-') {
-          is_positive = false;
-          input.ignore();
+    // The text of the number is parsed as a whole, so that doubles are rounded correctly
+    // and the ones printed by PrintExact read back unchanged.
+    template <typename Input>
+    Node LoadNumber(Input& input) {
+      string text;
+      auto read_digits = [&input, &text] {
+        while (isdigit(input.Peek())) text.push_back(static_cast<char>(input.Get()));
+      };
+      if (input.Peek() == '-') text.push_back(static_cast<char>(input.Get()));
+      read_digits();
+      bool is_integer = true;
+      if (input.Peek() == '.') {
+        is_integer = false;
+        text.push_back(static_cast<char>(input.Get()));
+        read_digits();
       }
-      int result = LoadInt(input).AsInt();
-      if (input.peek() == '.') {
-          input.ignore();
-          double result_double = result;
-          double append_power = 0.1;
-          while (isdigit(input.peek())) {
-              result_double += append_power * (input.get() - '0');
-              append_power /= 10;
-          }
-          return is_positive ? result_double : -1 * result_double;
+      if (input.Peek() == 'e' || input.Peek() == 'E') {
+        is_integer = false;
+        text.push_back(static_cast<char>(input.Get()));
+        if (input.Peek() == '+' || input.Peek() == '-') text.push_back(static_cast<char>(input.Get()));
+        read_digits();
       }
-      return is_positive ? result : -1 * result;
-  }
+      const char* const end = text.data() + text.size();
+      if (is_integer) {
+        int result = 0;
+        const auto [ptr, ec] = from_chars(text.data(), end, result);
+        if (ec == errc() && ptr == end) return result;
+        // an integer that doesn't fit an int is still a number
+        if (ec != errc::result_out_of_range) throw runtime_error("invalid number " + text);
+      }
+      double result = 0;
+      const auto [ptr, ec] = from_chars(text.data(), end, result);
+      if (ec != errc() || ptr != end) throw runtime_error("invalid number " + text);
+      return result;
+    }
 
-  Node LoadString(istream& input) {
-    string line;
-    getline(input, line, '"');
-    return Node(move(line));
-  }
+    template <typename Input>
+    string LoadString(Input& input) {
+      return input.ReadUntil('"');
+    }
 
-  Node LoadDict(istream& input) {
-    map<string, Node> result;
+    template <typename Input>
+    Node LoadDict(Input& input) {
+      map<string, Node> result;
 
-    for (char c; input >> c && c != '}'; ) {
-      if (c == ',') {
-        input >> c;
+      for (char c; input.ReadNonSpace(c) && c != '}'; ) {
+        if (c == ',') {
+          input.ReadNonSpace(c);
+        }
+
+        string key = LoadString(input);
+        input.ReadNonSpace(c);
+        result.emplace(move(key), LoadNode(input));
       }
 
-      string key = LoadString(input).AsString();
-      input >> c;
-      result.emplace(move(key), LoadNode(input));
+      return Node(move(result));
     }
 
-    return Node(move(result));
-  }
+    template <typename Input>
+    Node LoadNode(Input& input) {
+      char c = '\0';
+      input.ReadNonSpace(c);
 
-    Node LoadNode(istream& input) {
-        char c;
-        while (input.peek() == ' ') input.ignore(1);
-        input >> c;
-
-        if (c == '[') {
-            return LoadArray(input);
-        } else if (c == '{') {
-            return LoadDict(input);
-        } else if (c == '"') {
-            return LoadString(input);
-        } else if (isdigit(c) || c == '-') {
-            input.putback(c);
-            return LoadNumber(input);
-        } else if (c == 't' || c == 'f') {
-            input.putback(c);
-            return LoadBool(input);
-        }
-        throw std::runtime_error("unknown type of c");
+      if (c == '[') {
+        return LoadArray(input);
+      } else if (c == '{') {
+        return LoadDict(input);
+      } else if (c == '"') {
+        return LoadString(input);
+      } else if (isdigit(c) || c == '-') {
+        input.PutBack();
+        return LoadNumber(input);
+      } else if (c == 't' || c == 'f') {
+        input.PutBack();
+        return LoadBool(input);
+      } else if (c == 'n') {
+        input.Ignore(3);
+        return nullptr;
+      }
+      throw std::runtime_error("unknown type of c");
     }
+  }
 
     Document Load(istream& input) {
-        return Document{LoadNode(input)};
+        StreamInput stream_input(input);
+        return Document{LoadNode(stream_input)};
+    }
+
+    Document Load(string_view data) {
+        MemoryInput memory_input(data);
+        return Document{LoadNode(memory_input)};
+    }
+
+    Document LoadFile(const string& path) {
+        MappedFile file(path, true);
+        return Load(file.GetData());
+    }
+
+    string ReadAll(istream& input) {
+        constexpr size_t block_size = 1 << 20;
+        string result;
+        while (input) {
+            const size_t size = result.size();
+            result.resize(size + block_size);
+            input.read(result.data() + size, block_size);
+            result.resize(size + input.gcount());
+        }
+        return result;
     }
 
     void Print(const Document& document, std::ostream& output) {
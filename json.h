@@ -1,8 +1,10 @@
 #pragma once
 
+#include <cstddef>
 #include <istream>
 #include <map>
 #include <string>
+#include <string_view>
 #include <variant>
 #include <vector>
 #include <iostream>
@@ -14,7 +16,8 @@ namespace Json {
                             bool,
                             int,
                             double,
-                            std::string> {
+                            std::string,
+                            std::nullptr_t> {
   public:
     using variant::variant;
 
@@ -39,7 +42,26 @@ namespace Json {
     bool HoldsInt() const {
         return std::holds_alternative<int>(*this);
     }
+    bool HoldsMap() const {
+        return std::holds_alternative<std::map<std::string, Node>>(*this);
+    }
+    bool HoldsArray() const {
+        return std::holds_alternative<std::vector<Node>>(*this);
+    }
+    bool HoldsDouble() const {
+        return std::holds_alternative<double>(*this);
+    }
+    bool HoldsBool() const {
+        return std::holds_alternative<bool>(*this);
+    }
+    bool HoldsString() const {
+        return std::holds_alternative<std::string>(*this);
+    }
+    bool IsNull() const {
+        return std::holds_alternative<std::nullptr_t>(*this);
+    }
     friend std::ostream& operator << (std::ostream&, const Node&);
+    friend void PrintCompact(const Node&, std::ostream&);
   };
 
   class Document {
@@ -52,6 +74,16 @@ namespace Json {
     Node root;
   };
 
+  // reads exactly one document from the stream
   Document Load(std::istream& input = std::cin);
+  Document Load(std::string_view data);
+  // maps the file and parses it straight from the mapping
+  Document LoadFile(const std::string& path);
+  // reads the whole stream in large blocks, for parsing with Load(std::string_view)
+  std::string ReadAll(std::istream& input = std::cin);
   void Print(const Document&, std::ostream& output = std::cout);
+  // prints the node on a single line, for newline-delimited streams
+  void PrintCompact(const Node&, std::ostream& output = std::cout);
+  // PrintCompact with every digit of doubles, so that they read back unchanged
+  void PrintExact(const Node&, std::ostream& output = std::cout);
 }
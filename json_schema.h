@@ -0,0 +1,213 @@
+#pragma once
+
+#include "json.h"
+
+#include <array>
+#include <cstddef>
+#include <map>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace Json {
+
+  // A value that doesn't fit the schema: a missing required field or a value of a wrong type.
+  // The field is the path from the decoded value, as in "from.latitude" or "stops[2]".
+  class SchemaError : public std::invalid_argument {
+  public:
+    SchemaError(const std::string& field, const std::string& reason)
+        : std::invalid_argument(field.empty() ? reason : field + ": " + reason), field_(field), reason_(reason) {}
+    const std::string& GetField() const { return field_; }
+    const std::string& GetReason() const { return reason_; }
+  private:
+    std::string field_, reason_;
+  };
+
+  // Decoder<T>::Decode(node, value) reads a T from a node; specialize it for other types,
+  // objects usually with a Schema
+  template <typename T>
+  struct Decoder;
+
+  template <typename T>
+  T Decode(const Node& node) {
+    T value{};
+    Decoder<T>::Decode(node, value);
+    return value;
+  }
+
+  // runs decode and puts field in front of the path of its errors
+  template <typename Decode>
+  void DecodeField(const std::string& field, Decode&& decode) {
+    try {
+      decode();
+    } catch (const SchemaError& error) {
+      const std::string& inner = error.GetField();
+      throw SchemaError(inner.empty() ? field : inner.front() == '[' ? field + inner : field + "." + inner, error.GetReason());
+    }
+  }
+
+  template <>
+  struct Decoder<int> {
+    static void Decode(const Node& node, int& value) {
+      if (!node.HoldsInt()) throw SchemaError("", "expected an integer");
+      value = node.AsInt();
+    }
+  };
+
+  template <>
+  struct Decoder<size_t> {
+    static void Decode(const Node& node, size_t& value) {
+      if (!node.HoldsInt() || node.AsInt() < 0) throw SchemaError("", "expected a non-negative integer");
+      value = node.AsInt();
+    }
+  };
+
+  template <>
+  struct Decoder<double> {
+    static void Decode(const Node& node, double& value) {
+      if (node.HoldsInt()) value = node.AsInt();
+      else if (node.HoldsDouble()) value = node.AsDouble();
+      else throw SchemaError("", "expected a number");
+    }
+  };
+
+  template <>
+  struct Decoder<bool> {
+    static void Decode(const Node& node, bool& value) {
+      if (!node.HoldsBool()) throw SchemaError("", "expected a boolean");
+      value = node.AsBool();
+    }
+  };
+
+  template <>
+  struct Decoder<std::string> {
+    static void Decode(const Node& node, std::string& value) {
+      if (!node.HoldsString()) throw SchemaError("", "expected a string");
+      value = node.AsString();
+    }
+  };
+
+  template <typename T>
+  struct Decoder<std::optional<T>> {
+    static void Decode(const Node& node, std::optional<T>& value) {
+      Decoder<T>::Decode(node, value.emplace());
+    }
+  };
+
+  template <typename T>
+  struct Decoder<std::vector<T>> {
+    static void Decode(const Node& node, std::vector<T>& value) {
+      if (!node.HoldsArray()) throw SchemaError("", "expected an array");
+      const auto& items = node.AsArray();
+      value.resize(items.size());
+      for (size_t i = 0; i < items.size(); ++i) {
+        DecodeField("[" + std::to_string(i) + "]", [&] { Decoder<T>::Decode(items[i], value[i]); });
+      }
+    }
+  };
+
+  template <typename Map>
+  struct MapDecoder {
+    static void Decode(const Node& node, Map& value) {
+      if (!node.HoldsMap()) throw SchemaError("", "expected an object");
+      for (const auto& [key, item] : node.AsMap()) {
+        DecodeField(key, [&] { Decoder<typename Map::mapped_type>::Decode(item, value[key]); });
+      }
+    }
+  };
+  template <typename T>
+  struct Decoder<std::map<std::string, T>> : MapDecoder<std::map<std::string, T>> {};
+  template <typename T>
+  struct Decoder<std::unordered_map<std::string, T>> : MapDecoder<std::unordered_map<std::string, T>> {};
+
+  // a field decoded into a member
+  template <typename Object, typename Member>
+  struct MemberField {
+    std::string_view name;
+    Member Object::* member;
+    bool is_required;
+    void Decode(const Node& node, Object& object) const { Decoder<Member>::Decode(node, object.*member); }
+  };
+
+  // a field decoded by a function, for values that are converted or go to nested members
+  template <typename Object>
+  struct FunctionField {
+    std::string_view name;
+    void (*decode)(const Node& node, Object& object);
+    bool is_required;
+    void Decode(const Node& node, Object& object) const { decode(node, object); }
+  };
+
+  template <typename Object, typename Member>
+  constexpr MemberField<Object, Member> Required(std::string_view name, Member Object::* member) {
+    return {name, member, true};
+  }
+  template <typename Object, typename Member>
+  constexpr MemberField<Object, Member> Optional(std::string_view name, Member Object::* member) {
+    return {name, member, false};
+  }
+  template <typename Object>
+  constexpr FunctionField<Object> Required(std::string_view name, void (*decode)(const Node&, Object&)) {
+    return {name, decode, true};
+  }
+  template <typename Object>
+  constexpr FunctionField<Object> Optional(std::string_view name, void (*decode)(const Node&, Object&)) {
+    return {name, decode, false};
+  }
+
+  // The fields of an object, declared once. Decode makes one pass over the members of a json object,
+  // each going straight to its field; unknown members are skipped.
+  template <typename Object, typename... Fields>
+  class Schema {
+  public:
+    constexpr explicit Schema(Fields... fields) : fields_(fields...) {}
+
+    void Decode(const Node& node, Object& object) const {
+      if (!node.HoldsMap()) throw SchemaError("", "expected an object");
+      std::array<bool, sizeof...(Fields)> is_found{};
+      for (const auto& [name, value] : node.AsMap()) {
+        DecodeMember(name, value, object, is_found, std::index_sequence_for<Fields...>());
+      }
+      CheckRequired(is_found, std::index_sequence_for<Fields...>());
+    }
+
+    Object Decode(const Node& node) const {
+      Object object{};
+      Decode(node, object);
+      return object;
+    }
+
+  private:
+    std::tuple<Fields...> fields_;
+
+    template <size_t... I>
+    void DecodeMember(const std::string& name, const Node& value, Object& object,
+                      std::array<bool, sizeof...(Fields)>& is_found, std::index_sequence<I...>) const {
+      auto decode = [&](const auto& field, bool& field_is_found) {
+        if (field.name != name) return false;
+        DecodeField(name, [&] { field.Decode(value, object); });
+        field_is_found = true;
+        return true;
+      };
+      (decode(std::get<I>(fields_), is_found[I]) || ...);
+    }
+
+    template <size_t... I>
+    void CheckRequired(const std::array<bool, sizeof...(Fields)>& is_found, std::index_sequence<I...>) const {
+      auto check = [](const auto& field, bool field_is_found) {
+        if (field.is_required && !field_is_found) throw SchemaError(std::string(field.name), "is missing");
+      };
+      (check(std::get<I>(fields_), is_found[I]), ...);
+    }
+  };
+
+  template <typename Object, typename... Fields>
+  constexpr Schema<Object, Fields...> MakeSchema(Fields... fields) {
+    return Schema<Object, Fields...>(fields...);
+  }
+}
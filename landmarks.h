@@ -0,0 +1,116 @@
+#pragma once
+
+#include "graph.h"
+#include "graph_search.h"
+#include "memory_usage.h"
+
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+namespace Graph {
+
+  // ALT preprocessing: distances from and to a few landmark vertices give, by the triangle inequality,
+  // lower bounds on the distance between any two vertices. The bounds form a consistent potential for A*.
+  // Landmarks are picked by the farthest-point rule, so unexplored components get a landmark first.
+  template <typename Weight>
+  class Landmarks {
+  public:
+    Landmarks() = default;
+    Landmarks(const DirectedWeightedGraph<Weight>& graph, size_t landmark_count);
+
+    Weight GetLowerBound(VertexId from, VertexId to) const;
+    const std::vector<VertexId>& GetVertexes() const;
+    size_t GetMemoryUsage() const;
+
+  private:
+    static constexpr Weight unreachable = std::numeric_limits<Weight>::max();
+    std::vector<VertexId> vertexes_;
+    // distances_from_[i][v]: from the i-th landmark to v, distances_to_[i][v]: from v to the landmark
+    std::vector<std::vector<Weight>> distances_from_, distances_to_;
+
+    static std::vector<Weight> ComputeDistances(const DirectedWeightedGraph<Weight>& graph, VertexId source,
+                                                DijkstraSearch<Weight>& search);
+  };
+
+
+  template <typename Weight>
+  Landmarks<Weight>::Landmarks(const DirectedWeightedGraph<Weight>& graph, size_t landmark_count) {
+    const size_t vertex_count = graph.GetVertexCount();
+    if (vertex_count == 0) {
+      return;
+    }
+    DirectedWeightedGraph<Weight> reversed_graph(vertex_count, graph.GetEdgeCount());
+    for (EdgeId edge_id = 0; edge_id < graph.GetEdgeCount(); ++edge_id) {
+      const auto& edge = graph.GetEdge(edge_id);
+      reversed_graph.SetEdge(edge_id, {edge.to, edge.from, edge.weight});
+    }
+    reversed_graph.BuildIncidenceLists();
+
+    DijkstraSearch<Weight> search;
+    // the first landmark is the vertex farthest from vertex 0
+    std::vector<Weight> closest_landmark = ComputeDistances(graph, 0, search);
+    VertexId next = 0;
+    for (VertexId vertex = 0; vertex < vertex_count; ++vertex) {
+      if (closest_landmark[vertex] != unreachable && closest_landmark[vertex] > closest_landmark[next]) {
+        next = vertex;
+      }
+    }
+    closest_landmark.assign(vertex_count, unreachable);
+    while (vertexes_.size() < std::min(landmark_count, vertex_count)) {
+      vertexes_.push_back(next);
+      distances_from_.push_back(ComputeDistances(graph, next, search));
+      distances_to_.push_back(ComputeDistances(reversed_graph, next, search));
+      for (VertexId vertex = 0; vertex < vertex_count; ++vertex) {
+        closest_landmark[vertex] = std::min(closest_landmark[vertex], distances_from_.back()[vertex]);
+      }
+      // a vertex that no landmark reaches wins, then the one farthest from its closest landmark
+      next = std::max_element(closest_landmark.begin(), closest_landmark.end()) - closest_landmark.begin();
+      if (closest_landmark[next] == 0) {
+        break;
+      }
+    }
+  }
+
+  template <typename Weight>
+  std::vector<Weight> Landmarks<Weight>::ComputeDistances(const DirectedWeightedGraph<Weight>& graph, VertexId source,
+                                                          DijkstraSearch<Weight>& search) {
+    search.Start(graph.GetVertexCount());
+    search.AddSource(source, 0);
+    search.Run(graph, [](VertexId, Weight) { return true; });
+    std::vector<Weight> distances(graph.GetVertexCount(), unreachable);
+    for (VertexId vertex = 0; vertex < graph.GetVertexCount(); ++vertex) {
+      if (search.IsReached(vertex)) {
+        distances[vertex] = search.GetWeight(vertex);
+      }
+    }
+    return distances;
+  }
+
+  template <typename Weight>
+  Weight Landmarks<Weight>::GetLowerBound(VertexId from, VertexId to) const {
+    Weight result = 0;
+    for (size_t i = 0; i < vertexes_.size(); ++i) {
+      const auto& distances_to = distances_to_[i];
+      const auto& distances_from = distances_from_[i];
+      // d(from, to) >= d(from, L) - d(to, L) and d(from, to) >= d(L, to) - d(L, from)
+      if (distances_to[from] != unreachable && distances_to[to] != unreachable && distances_to[from] > distances_to[to]) {
+        result = std::max(result, distances_to[from] - distances_to[to]);
+      }
+      if (distances_from[to] != unreachable && distances_from[from] != unreachable && distances_from[to] > distances_from[from]) {
+        result = std::max(result, distances_from[to] - distances_from[from]);
+      }
+    }
+    return result;
+  }
+
+  template <typename Weight>
+  const std::vector<VertexId>& Landmarks<Weight>::GetVertexes() const {
+    return vertexes_;
+  }
+
+  template <typename Weight>
+  size_t Landmarks<Weight>::GetMemoryUsage() const {
+    return Memory::HeapBytes(vertexes_) + Memory::HeapBytes(distances_from_) + Memory::HeapBytes(distances_to_);
+  }
+}
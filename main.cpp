@@ -1,14 +1,115 @@
 #include "tests.h"
 #include "transport_database.h"
 #include "requests.h"
+#include "server.h"
+#include "flat_database.h"
+#include "mapped_file.h"
+#include "benchmark.h"
+#include "sharding.h"
+
+#include <string_view>
 
 using namespace Transport;
 using namespace Requests;
 
-int main() {
-    TestAll();
-    TransportDatabase tdb;
-    Json::Print(ProcessRequests(ParseRequests(Json::Load()), tdb));
-
+// usage: transport [INPUT]
+//        transport --test
+//        transport --serve [--base FILE] [--socket PATH] [--light-threads N] [--heavy-threads N] [--warmup LOG] [--exact-numbers]
+//        transport --build-flat IMAGE [--base FILE]
+//        transport --attach IMAGE
+//        transport --bench-routes N [--base FILE]
+//        transport --shards N --base FILE
+int main(int argc, char* argv[]) {
+    // the tests read examples/ relative to the working directory; the server, flat and shard modes don't run them
+    if (argc == 2 && std::string_view(argv[1]) == "--test") {
+        TestAll();
+        return 0;
+    }
+    if (argc == 1 || (argc == 2 && std::string_view(argv[1]).substr(0, 2) != "--")) {
+        TestAll();
+        std::ios::sync_with_stdio(false);
+        TransportDatabase tdb;
+        Json::Document document = argc == 1 ? Json::Load(Json::ReadAll()) : Json::LoadFile(argv[1]);
+        Json::Print(ProcessRequests(ParseRequests(document), tdb));
+        return 0;
+    }
+    std::string base_path, socket_path, build_flat_path, attach_path;
+    size_t bench_route_count = 0, shard_count = 0;
+    Server::ServerSettings server_settings;
+    bool is_serve = false;
+    for (int i = 1; i < argc; ++i) {
+        std::string_view arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--serve") {
+            is_serve = true;
+        } else if (arg == "--base" && has_value) {
+            base_path = argv[++i];
+        } else if (arg == "--socket" && has_value) {
+            socket_path = argv[++i];
+        } else if (arg == "--light-threads" && has_value) {
+            server_settings.light_threads = std::stoul(argv[++i]);
+        } else if (arg == "--heavy-threads" && has_value) {
+            server_settings.heavy_threads = std::stoul(argv[++i]);
+        } else if (arg == "--warmup" && has_value) {
+            server_settings.warmup_path = argv[++i];
+        } else if (arg == "--exact-numbers") {
+            server_settings.exact_numbers = true;
+        } else if (arg == "--build-flat" && has_value) {
+            build_flat_path = argv[++i];
+        } else if (arg == "--attach" && has_value) {
+            attach_path = argv[++i];
+        } else if (arg == "--bench-routes" && has_value) {
+            bench_route_count = std::stoul(argv[++i]);
+        } else if (arg == "--shards" && has_value) {
+            shard_count = std::stoul(argv[++i]);
+        } else {
+            std::cerr << "unknown argument " << arg << std::endl;
+            return 1;
+        }
+    }
+    if (!attach_path.empty()) {
+        MappedFile image(attach_path);
+        Json::Print(ProcessStatRequests(Json::Load(), FlatDatabaseView(image.GetData())));
+        return 0;
+    }
+    if (bench_route_count != 0) {
+        Json::Document base = base_path.empty() ? Json::Load(Json::ReadAll()) : Json::LoadFile(base_path);
+        for (const auto& result : Benchmark::BenchmarkVertexOrders(base, bench_route_count)) std::cout << result << std::endl;
+        return 0;
+    }
+    if (shard_count != 0) {
+        // stat requests come from stdin, so the base is read from a file
+        if (base_path.empty()) {
+            std::cerr << "--shards needs --base" << std::endl;
+            return 1;
+        }
+        Sharding::Regions regions = Sharding::SplitBase(Json::LoadFile(base_path), shard_count);
+        std::vector<std::unique_ptr<Sharding::ShardProcess>> shard_processes;
+        std::vector<Sharding::ShardConnection> shards;
+        for (const auto& base : regions.bases) {
+            auto& shard_process = shard_processes.emplace_back(std::make_unique<Sharding::ShardProcess>(base));
+            shards.emplace_back([shard = shard_process.get()](const Json::Node& request) { return shard->Ask(request); });
+        }
+        regions.bases.clear();
+        Sharding::Coordinator coordinator(regions, std::move(shards));
+        Json::Print(Sharding::ProcessStatRequests(Json::Load(), coordinator));
+        return 0;
+    }
+    DatabaseSnapshots::Snapshot snapshot = base_path.empty() ? Server::LoadSnapshot(std::cin) : Server::LoadSnapshot(base_path);
+    if (!build_flat_path.empty()) {
+        WriteFlatDatabase(*snapshot, build_flat_path);
+        return 0;
+    }
+    if (!is_serve) {
+        std::cerr << "--serve, --build-flat, --attach, --bench-routes or --shards is expected" << std::endl;
+        return 1;
+    }
+    DatabaseSnapshots snapshots(std::move(snapshot));
+    Server::QueryServer server(snapshots, server_settings);
+    if (socket_path.empty()) {
+        server.Serve(std::cin, std::cout);
+    } else {
+        server.ServeUnixSocket(socket_path);
+    }
     return 0;
 }
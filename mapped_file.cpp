@@ -0,0 +1,32 @@
+#include "mapped_file.h"
+
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MappedFile::MappedFile(const std::string& path, bool is_sequential) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) throw std::runtime_error("can't open " + path);
+    struct stat file_stat{};
+    if (fstat(fd, &file_stat) != 0) {
+        close(fd);
+        throw std::runtime_error("can't stat " + path);
+    }
+    size_ = file_stat.st_size;
+    if (size_ != 0) {
+        void* data = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+        if (data == MAP_FAILED) {
+            close(fd);
+            throw std::runtime_error("can't map " + path);
+        }
+        data_ = static_cast<const char*>(data);
+        if (is_sequential) madvise(data, size_, MADV_SEQUENTIAL);
+    }
+    close(fd);
+}
+MappedFile::~MappedFile() {
+    if (data_) munmap(const_cast<char*>(data_), size_);
+}
+std::string_view MappedFile::GetData() const { return {data_, size_}; }
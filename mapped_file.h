@@ -0,0 +1,23 @@
+#pragma once
+
+#ifndef CPPCOURSERA_MAPPED_FILE_H
+#define CPPCOURSERA_MAPPED_FILE_H
+
+#endif //CPPCOURSERA_MAPPED_FILE_H
+
+#include <string>
+#include <string_view>
+
+// Read-only shared mapping of a whole file. Pages are shared between all processes mapping the same file.
+// A sequential mapping asks the kernel for aggressive read-ahead.
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& path, bool is_sequential = false);
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator = (const MappedFile&) = delete;
+    ~MappedFile();
+    std::string_view GetData() const;
+private:
+    const char* data_{nullptr};
+    size_t size_{0};
+};
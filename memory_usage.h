@@ -0,0 +1,81 @@
+#pragma once
+
+#ifndef CPPCOURSERA_MEMORY_USAGE_H
+#define CPPCOURSERA_MEMORY_USAGE_H
+
+#endif //CPPCOURSERA_MEMORY_USAGE_H
+
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <optional>
+#include <set>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Estimates of heap bytes owned by a value (sizeof(value) itself is not included).
+// Node sizes are approximated for libstdc++: a hash node keeps a next pointer and a cached hash,
+// a tree node keeps three pointers and a colour.
+namespace Memory {
+    constexpr size_t hash_node_overhead = 2 * sizeof(void*);
+    constexpr size_t tree_node_overhead = 4 * sizeof(void*);
+
+    template <typename T> size_t HeapBytes(const T&);
+    inline size_t HeapBytes(const std::string&);
+    template <typename T> size_t HeapBytes(const std::shared_ptr<T>&);
+    template <typename T> size_t HeapBytes(const std::optional<T>&);
+    template <typename First, typename Second> size_t HeapBytes(const std::pair<First, Second>&);
+    template <typename T> size_t HeapBytes(const std::vector<T>&);
+    template <typename T> size_t HeapBytes(const std::set<T>&);
+    template <typename Key, typename Value> size_t HeapBytes(const std::map<Key, Value>&);
+    template <typename Key, typename Value> size_t HeapBytes(const std::unordered_map<Key, Value>&);
+
+    template <typename T>
+    size_t HeapBytes(const T&) {
+        static_assert(std::is_trivially_copyable_v<T>, "no heap estimate for this type");
+        return 0;
+    }
+    inline size_t HeapBytes(const std::string& str) {
+        return str.capacity() > std::string().capacity() ? str.capacity() + 1 : 0;
+    }
+    template <typename T>
+    size_t HeapBytes(const std::shared_ptr<T>&) { return 0; } // shared objects are accounted by their owner
+    template <typename T>
+    size_t HeapBytes(const std::optional<T>& value) { return value ? HeapBytes(*value) : 0; }
+    template <typename First, typename Second>
+    size_t HeapBytes(const std::pair<First, Second>& value) {
+        return HeapBytes(value.first) + HeapBytes(value.second);
+    }
+    template <typename T>
+    size_t HeapBytes(const std::vector<T>& values) {
+        size_t result = values.capacity() * sizeof(T);
+        if constexpr (!std::is_trivially_copyable_v<T>) {
+            for (const auto& value : values) result += HeapBytes(value);
+        }
+        return result;
+    }
+    template <typename T>
+    size_t HeapBytes(const std::set<T>& values) {
+        size_t result = values.size() * (sizeof(T) + tree_node_overhead);
+        if constexpr (!std::is_trivially_copyable_v<T>) {
+            for (const auto& value : values) result += HeapBytes(value);
+        }
+        return result;
+    }
+    template <typename Key, typename Value>
+    size_t HeapBytes(const std::map<Key, Value>& values) {
+        size_t result = values.size() * (sizeof(std::pair<const Key, Value>) + tree_node_overhead);
+        for (const auto& value : values) result += HeapBytes(value);
+        return result;
+    }
+    template <typename Key, typename Value>
+    size_t HeapBytes(const std::unordered_map<Key, Value>& values) {
+        size_t result = values.bucket_count() * sizeof(void*) +
+                values.size() * (sizeof(std::pair<const Key, Value>) + hash_node_overhead);
+        for (const auto& value : values) result += HeapBytes(value);
+        return result;
+    }
+}
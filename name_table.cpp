@@ -0,0 +1,110 @@
+#include "name_table.h"
+#include "memory_usage.h"
+
+#include <algorithm>
+#include <numeric>
+#include <stdexcept>
+
+namespace Transport {
+    namespace {
+        uint64_t Mix(uint64_t value) {
+            value ^= value >> 30u;
+            value *= 0xbf58476d1ce4e5b9ull;
+            value ^= value >> 27u;
+            value *= 0x94d049bb133111ebull;
+            return value ^ (value >> 31u);
+        }
+    }
+    NameTable::NameTable(const std::vector<std::string_view>& names) {
+        if (names.size() >= direct_slot) throw std::invalid_argument("too many names for a name table");
+        // a salt changes every hash, for the unlikely set whose buckets can't be placed
+        for (salt_ = 0; !TryBuild(names); ++salt_) {}
+    }
+    uint64_t NameTable::Hash(std::string_view name) const {
+        uint64_t hash = 0xcbf29ce484222325ull ^ salt_;
+        for (char c : name) hash = (hash ^ static_cast<unsigned char>(c)) * 0x100000001b3ull;
+        return Mix(hash);
+    }
+    size_t NameTable::GetSlot(uint64_t hash, uint32_t seed) const {
+        return Mix(hash + (seed + 1) * 0x9e3779b97f4a7c15ull) % indexes_.size();
+    }
+    bool NameTable::TryBuild(const std::vector<std::string_view>& names) {
+        const size_t name_count = names.size();
+        seeds_.assign(std::max<size_t>(1, (name_count + bucket_size - 1) / bucket_size), 0);
+        indexes_.assign(name_count, 0);
+        std::vector<uint64_t> hashes(name_count);
+        std::vector<std::vector<uint32_t>> buckets(seeds_.size());
+        for (uint32_t i = 0; i < name_count; ++i) {
+            hashes[i] = Hash(names[i]);
+            buckets[hashes[i] % seeds_.size()].push_back(i);
+        }
+        std::vector<uint32_t> bucket_order(buckets.size());
+        std::iota(bucket_order.begin(), bucket_order.end(), 0);
+        std::stable_sort(bucket_order.begin(), bucket_order.end(), [&buckets](uint32_t lhs, uint32_t rhs) {
+            return buckets[lhs].size() > buckets[rhs].size();
+        });
+        std::vector<bool> is_taken(name_count);
+        std::vector<size_t> slots;
+        size_t next_free_slot = 0;
+        for (uint32_t bucket : bucket_order) {
+            const std::vector<uint32_t>& bucket_names = buckets[bucket];
+            if (bucket_names.size() == 1) {
+                // the largest buckets are placed first, the names left alone take the free slots in order
+                while (is_taken[next_free_slot]) ++next_free_slot;
+                seeds_[bucket] = direct_slot | next_free_slot;
+                is_taken[next_free_slot] = true;
+                indexes_[next_free_slot] = bucket_names.front();
+                continue;
+            }
+            for (size_t i = 0; i < bucket_names.size(); ++i) {
+                for (size_t j = 0; j < i; ++j) {
+                    if (hashes[bucket_names[i]] != hashes[bucket_names[j]]) continue;
+                    if (names[bucket_names[i]] == names[bucket_names[j]]) {
+                        throw std::invalid_argument("repeated name " + std::string(names[bucket_names[i]]));
+                    }
+                    return false;
+                }
+            }
+            bool is_placed = false;
+            for (uint32_t seed = 0; seed < max_seed && !is_placed; ++seed) {
+                slots.clear();
+                for (uint32_t name : bucket_names) {
+                    const size_t slot = GetSlot(hashes[name], seed);
+                    if (is_taken[slot] || std::find(slots.begin(), slots.end(), slot) != slots.end()) break;
+                    slots.push_back(slot);
+                }
+                if (slots.size() != bucket_names.size()) continue;
+                seeds_[bucket] = seed;
+                for (size_t i = 0; i < slots.size(); ++i) {
+                    is_taken[slots[i]] = true;
+                    indexes_[slots[i]] = bucket_names[i];
+                }
+                is_placed = true;
+            }
+            if (!is_placed) return false;
+        }
+        names_.clear();
+        name_offsets_.assign(1, 0);
+        for (uint32_t index : indexes_) {
+            names_ += names[index];
+            name_offsets_.push_back(names_.size());
+        }
+        return true;
+    }
+    std::optional<uint32_t> NameTable::Find(std::string_view name) const {
+        if (indexes_.empty()) return std::nullopt;
+        const uint64_t hash = Hash(name);
+        const uint32_t seed = seeds_[hash % seeds_.size()];
+        const size_t slot = (seed & direct_slot) != 0 ? seed & ~direct_slot : GetSlot(hash, seed);
+        const std::string_view slot_name(names_.data() + name_offsets_[slot], name_offsets_[slot + 1] - name_offsets_[slot]);
+        if (slot_name != name) return std::nullopt;
+        return indexes_[slot];
+    }
+    size_t NameTable::GetSize() const {
+        return indexes_.size();
+    }
+    size_t NameTable::GetMemoryUsage() const {
+        return Memory::HeapBytes(seeds_) + Memory::HeapBytes(indexes_) + Memory::HeapBytes(name_offsets_) +
+               Memory::HeapBytes(names_);
+    }
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#ifndef CPPCOURSERA_NAME_TABLE_H
+#define CPPCOURSERA_NAME_TABLE_H
+
+#endif //CPPCOURSERA_NAME_TABLE_H
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace Transport {
+    // Minimal perfect hash of a fixed set of names (hash and displace): names fall into buckets of about
+    // four, and a bucket keeps the seed that sends its names to free slots, or the slot itself for a bucket
+    // of one name. A lookup hashes the name once, reads a seed and compares the name stored in its slot.
+    // Find returns the position the name had in the vector the table was built from.
+    class NameTable {
+    public:
+        NameTable() = default;
+        // throws std::invalid_argument for a repeated name
+        explicit NameTable(const std::vector<std::string_view>& names);
+        std::optional<uint32_t> Find(std::string_view name) const;
+        size_t GetSize() const;
+        size_t GetMemoryUsage() const;
+    private:
+        static constexpr uint32_t direct_slot = 1u << 31u;
+        static constexpr size_t bucket_size = 4;
+        static constexpr uint32_t max_seed = 1u << 16u;
+        uint64_t salt_{0};
+        std::vector<uint32_t> seeds_;       // by bucket
+        std::vector<uint32_t> indexes_;     // by slot, the position of its name
+        std::vector<uint32_t> name_offsets_; // by slot, where its name starts in names_, and the end
+        std::string names_;
+        uint64_t Hash(std::string_view name) const;
+        size_t GetSlot(uint64_t hash, uint32_t seed) const;
+        bool TryBuild(const std::vector<std::string_view>& names);
+    };
+}
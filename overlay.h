@@ -0,0 +1,294 @@
+#pragma once
+
+#include "graph.h"
+#include "memory_usage.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <optional>
+#include <utility>
+#include <vector>
+
+namespace Graph {
+
+  // Customizable route planning over one level of cells. The partition depends only on the graph structure:
+  // cells of at most max_cell_size vertices are grown by breadth-first search over the undirected graph.
+  // A boundary vertex has an edge to or from another cell. Customize computes, for the current edge weights,
+  // the distances between the boundary vertices of each cell inside the cell (the cell clique), so a change
+  // of weights costs a search per boundary vertex within its cell instead of a rebuild.
+  // A query searches the original edges in the cells of both ends and the cliques and cut edges elsewhere;
+  // clique edges of the found path are unpacked by a search inside their cell.
+  template <typename Weight>
+  class Overlay {
+  public:
+    // scratch arrays of one query thread
+    class Search {
+    public:
+      size_t GetSettledCount() const { return settled_count_; }
+
+    private:
+      friend class Overlay;
+      struct VertexData {
+        Weight weight;
+        EdgeId prev_edge;     // the original edge into the vertex
+        VertexId prev_vertex; // or the boundary vertex of the clique edge into it
+        bool is_settled;
+      };
+      using QueueItem = std::pair<Weight, VertexId>;
+      uint32_t epoch_ = 0;
+      std::vector<uint32_t> epochs_;
+      std::vector<VertexData> vertexes_;
+      std::vector<QueueItem> queue_;
+      size_t settled_count_ = 0;
+    };
+
+    Overlay(const DirectedWeightedGraph<Weight>& graph, size_t max_cell_size);
+    // recomputes the cliques for the weights of graph, which has the structure the overlay was built for
+    void Customize(const DirectedWeightedGraph<Weight>& graph);
+
+    // edges of a shortest path in travel order
+    std::optional<std::vector<EdgeId>> FindRoute(VertexId from, VertexId to, Search& search) const;
+    size_t GetCellCount() const;
+    size_t GetBoundaryVertexCount() const;
+    size_t GetMemoryUsage() const;
+
+  private:
+    static constexpr Weight unreachable = std::numeric_limits<Weight>::max();
+    static constexpr EdgeId no_edge = std::numeric_limits<EdgeId>::max();
+    static constexpr VertexId no_vertex = std::numeric_limits<VertexId>::max();
+    static constexpr uint32_t no_index = std::numeric_limits<uint32_t>::max();
+
+    // Dijkstra from a vertex over the edges inside its cell, arrays are indexed by the position in the cell
+    struct CellSearch {
+      std::vector<Weight> weights;
+      std::vector<EdgeId> prev_edges;
+      std::vector<std::pair<Weight, uint32_t>> queue;
+    };
+
+    const DirectedWeightedGraph<Weight>* graph_ = nullptr;
+    std::vector<uint32_t> cell_by_vertex_;
+    std::vector<uint32_t> index_in_cell_;
+    std::vector<size_t> cell_offsets_;           // vertices of cell c are cell_vertices_[cell_offsets_[c]..]
+    std::vector<VertexId> cell_vertices_;
+    std::vector<size_t> boundary_offsets_;       // likewise for the boundary vertices
+    std::vector<VertexId> boundary_vertices_;
+    std::vector<uint32_t> boundary_index_;       // position of a vertex among the boundary vertices of its cell
+    std::vector<size_t> clique_offsets_;         // row-major clique of cell c from clique_offsets_[c]
+    std::vector<Weight> clique_weights_;
+
+    void SearchCell(VertexId source, CellSearch& search) const;
+  };
+
+
+  template <typename Weight>
+  Overlay<Weight>::Overlay(const DirectedWeightedGraph<Weight>& graph, size_t max_cell_size) {
+    const size_t vertex_count = graph.GetVertexCount();
+    max_cell_size = std::max<size_t>(max_cell_size, 1);
+    std::vector<std::vector<VertexId>> neighbours(vertex_count);
+    for (EdgeId edge_id = 0; edge_id < graph.GetEdgeCount(); ++edge_id) {
+      const auto& edge = graph.GetEdge(edge_id);
+      neighbours[edge.from].push_back(edge.to);
+      neighbours[edge.to].push_back(edge.from);
+    }
+
+    cell_by_vertex_.assign(vertex_count, no_index);
+    index_in_cell_.assign(vertex_count, 0);
+    cell_offsets_.push_back(0);
+    for (VertexId seed = 0; seed < vertex_count; ++seed) {
+      if (cell_by_vertex_[seed] != no_index) {
+        continue;
+      }
+      const uint32_t cell = cell_offsets_.size() - 1;
+      const size_t cell_begin = cell_vertices_.size();
+      cell_by_vertex_[seed] = cell;
+      cell_vertices_.push_back(seed);
+      for (size_t i = cell_begin; i < cell_vertices_.size() && cell_vertices_.size() - cell_begin < max_cell_size; ++i) {
+        for (VertexId neighbour : neighbours[cell_vertices_[i]]) {
+          if (cell_by_vertex_[neighbour] == no_index && cell_vertices_.size() - cell_begin < max_cell_size) {
+            cell_by_vertex_[neighbour] = cell;
+            cell_vertices_.push_back(neighbour);
+          }
+        }
+      }
+      for (size_t i = cell_begin; i < cell_vertices_.size(); ++i) {
+        index_in_cell_[cell_vertices_[i]] = i - cell_begin;
+      }
+      cell_offsets_.push_back(cell_vertices_.size());
+    }
+
+    boundary_index_.assign(vertex_count, no_index);
+    const size_t cell_count = cell_offsets_.size() - 1;
+    boundary_offsets_.push_back(0);
+    clique_offsets_.push_back(0);
+    for (uint32_t cell = 0; cell < cell_count; ++cell) {
+      const size_t boundary_begin = boundary_vertices_.size();
+      for (size_t i = cell_offsets_[cell]; i < cell_offsets_[cell + 1]; ++i) {
+        const VertexId vertex = cell_vertices_[i];
+        const bool is_boundary = std::any_of(neighbours[vertex].begin(), neighbours[vertex].end(), [&](VertexId neighbour) {
+          return cell_by_vertex_[neighbour] != cell;
+        });
+        if (is_boundary) {
+          boundary_index_[vertex] = boundary_vertices_.size() - boundary_begin;
+          boundary_vertices_.push_back(vertex);
+        }
+      }
+      const size_t boundary_count = boundary_vertices_.size() - boundary_begin;
+      boundary_offsets_.push_back(boundary_vertices_.size());
+      clique_offsets_.push_back(clique_offsets_.back() + boundary_count * boundary_count);
+    }
+    clique_weights_.assign(clique_offsets_.back(), unreachable);
+    Customize(graph);
+  }
+
+  template <typename Weight>
+  void Overlay<Weight>::SearchCell(VertexId source, CellSearch& search) const {
+    const uint32_t cell = cell_by_vertex_[source];
+    const size_t cell_size = cell_offsets_[cell + 1] - cell_offsets_[cell];
+    search.weights.assign(cell_size, unreachable);
+    search.prev_edges.assign(cell_size, no_edge);
+    search.queue.clear();
+    search.weights[index_in_cell_[source]] = 0;
+    search.queue.emplace_back(0, index_in_cell_[source]);
+    using QueueItem = std::pair<Weight, uint32_t>;
+    while (!search.queue.empty()) {
+      std::pop_heap(search.queue.begin(), search.queue.end(), std::greater<QueueItem>());
+      const auto [weight, index] = search.queue.back();
+      search.queue.pop_back();
+      if (search.weights[index] < weight) {
+        continue;
+      }
+      for (EdgeId edge_id : graph_->GetIncidentEdges(cell_vertices_[cell_offsets_[cell] + index])) {
+        const auto& edge = graph_->GetEdge(edge_id);
+        if (cell_by_vertex_[edge.to] != cell) {
+          continue;
+        }
+        const uint32_t to_index = index_in_cell_[edge.to];
+        const Weight to_weight = AddWeights(weight, edge.weight);
+        if (to_weight < search.weights[to_index]) {
+          search.weights[to_index] = to_weight;
+          search.prev_edges[to_index] = edge_id;
+          search.queue.emplace_back(to_weight, to_index);
+          std::push_heap(search.queue.begin(), search.queue.end(), std::greater<QueueItem>());
+        }
+      }
+    }
+  }
+
+  template <typename Weight>
+  void Overlay<Weight>::Customize(const DirectedWeightedGraph<Weight>& graph) {
+    graph_ = &graph;
+    ParallelFor(cell_offsets_.size() - 1, [this](size_t cell) {
+      CellSearch search;
+      const size_t boundary_begin = boundary_offsets_[cell], boundary_count = boundary_offsets_[cell + 1] - boundary_begin;
+      for (size_t i = 0; i < boundary_count; ++i) {
+        SearchCell(boundary_vertices_[boundary_begin + i], search);
+        for (size_t j = 0; j < boundary_count; ++j) {
+          clique_weights_[clique_offsets_[cell] + i * boundary_count + j] =
+              search.weights[index_in_cell_[boundary_vertices_[boundary_begin + j]]];
+        }
+      }
+    });
+  }
+
+  template <typename Weight>
+  std::optional<std::vector<EdgeId>> Overlay<Weight>::FindRoute(VertexId from, VertexId to, Search& search) const {
+    using QueueItem = typename Search::QueueItem;
+    const size_t vertex_count = cell_by_vertex_.size();
+    if (search.epochs_.size() != vertex_count || ++search.epoch_ == 0) {
+      search.epochs_.assign(vertex_count, 0);
+      search.vertexes_.resize(vertex_count);
+      search.epoch_ = 1;
+    }
+    search.queue_.clear();
+    search.settled_count_ = 0;
+    auto relax = [&search](VertexId vertex, Weight weight, EdgeId prev_edge, VertexId prev_vertex) {
+      auto& data = search.vertexes_[vertex];
+      if (search.epochs_[vertex] == search.epoch_ && !(weight < data.weight)) {
+        return;
+      }
+      search.epochs_[vertex] = search.epoch_;
+      data = {weight, prev_edge, prev_vertex, false};
+      search.queue_.emplace_back(weight, vertex);
+      std::push_heap(search.queue_.begin(), search.queue_.end(), std::greater<QueueItem>());
+    };
+
+    const uint32_t from_cell = cell_by_vertex_[from], to_cell = cell_by_vertex_[to];
+    relax(from, 0, no_edge, no_vertex);
+    while (!search.queue_.empty()) {
+      std::pop_heap(search.queue_.begin(), search.queue_.end(), std::greater<QueueItem>());
+      const auto [weight, vertex] = search.queue_.back();
+      search.queue_.pop_back();
+      auto& data = search.vertexes_[vertex];
+      if (data.is_settled || data.weight < weight) {
+        continue;
+      }
+      data.is_settled = true;
+      ++search.settled_count_;
+      if (vertex == to) {
+        break;
+      }
+      const uint32_t cell = cell_by_vertex_[vertex];
+      const bool is_end_cell = cell == from_cell || cell == to_cell;
+      if (!is_end_cell) {
+        // a vertex of another cell is reached through a cut edge, so it is a boundary vertex
+        const size_t boundary_begin = boundary_offsets_[cell], boundary_count = boundary_offsets_[cell + 1] - boundary_begin;
+        const size_t row = clique_offsets_[cell] + boundary_index_[vertex] * boundary_count;
+        for (size_t j = 0; j < boundary_count; ++j) {
+          if (clique_weights_[row + j] != unreachable && boundary_vertices_[boundary_begin + j] != vertex) {
+            relax(boundary_vertices_[boundary_begin + j], AddWeights(weight, clique_weights_[row + j]), no_edge, vertex);
+          }
+        }
+      }
+      for (EdgeId edge_id : graph_->GetIncidentEdges(vertex)) {
+        const auto& edge = graph_->GetEdge(edge_id);
+        if (is_end_cell || cell_by_vertex_[edge.to] != cell) {
+          relax(edge.to, AddWeights(weight, edge.weight), edge_id, no_vertex);
+        }
+      }
+    }
+    if (search.epochs_[to] != search.epoch_ || !search.vertexes_[to].is_settled) {
+      return std::nullopt;
+    }
+
+    std::vector<EdgeId> edges;
+    CellSearch cell_search;
+    for (VertexId vertex = to; vertex != from; ) {
+      const auto& data = search.vertexes_[vertex];
+      if (data.prev_edge != no_edge) {
+        edges.push_back(data.prev_edge);
+        vertex = graph_->GetEdge(data.prev_edge).from;
+        continue;
+      }
+      // the clique edge is the path the cell search from its boundary vertex finds
+      SearchCell(data.prev_vertex, cell_search);
+      for (VertexId current = vertex; current != data.prev_vertex; ) {
+        const EdgeId edge_id = cell_search.prev_edges[index_in_cell_[current]];
+        edges.push_back(edge_id);
+        current = graph_->GetEdge(edge_id).from;
+      }
+      vertex = data.prev_vertex;
+    }
+    std::reverse(edges.begin(), edges.end());
+    return edges;
+  }
+
+  template <typename Weight>
+  size_t Overlay<Weight>::GetCellCount() const {
+    return cell_offsets_.size() - 1;
+  }
+
+  template <typename Weight>
+  size_t Overlay<Weight>::GetBoundaryVertexCount() const {
+    return boundary_vertices_.size();
+  }
+
+  template <typename Weight>
+  size_t Overlay<Weight>::GetMemoryUsage() const {
+    return Memory::HeapBytes(cell_by_vertex_) + Memory::HeapBytes(index_in_cell_) + Memory::HeapBytes(cell_offsets_) +
+           Memory::HeapBytes(cell_vertices_) + Memory::HeapBytes(boundary_offsets_) + Memory::HeapBytes(boundary_vertices_) +
+           Memory::HeapBytes(boundary_index_) + Memory::HeapBytes(clique_offsets_) + Memory::HeapBytes(clique_weights_);
+  }
+}
@@ -0,0 +1,125 @@
+#pragma once
+
+#ifndef CPPCOURSERA_PARALLEL_H
+#define CPPCOURSERA_PARALLEL_H
+
+#endif //CPPCOURSERA_PARALLEL_H
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+inline size_t GetThreadCount() { return std::max(1u, std::thread::hardware_concurrency()); }
+
+// Calls func(i) for every i in [0, count) on up to thread_count threads, each thread taking
+// a contiguous block. The first exception thrown by func is rethrown to the caller.
+template <typename Func>
+void ParallelFor(size_t count, Func func, size_t thread_count = GetThreadCount()) {
+    thread_count = std::min(thread_count, count);
+    if (thread_count <= 1) {
+        for (size_t i = 0; i < count; ++i) func(i);
+        return;
+    }
+    std::exception_ptr error;
+    std::mutex error_mutex;
+    std::vector<std::thread> threads;
+    const size_t block_size = (count + thread_count - 1) / thread_count;
+    for (size_t begin = 0; begin < count; begin += block_size) {
+        threads.emplace_back([&, begin] {
+            try {
+                for (size_t i = begin; i < std::min(count, begin + block_size); ++i) func(i);
+            } catch (...) {
+                std::lock_guard<std::mutex> guard(error_mutex);
+                if (!error) error = std::current_exception();
+            }
+        });
+    }
+    for (auto& thread : threads) thread.join();
+    if (error) std::rethrow_exception(error);
+}
+
+// Threads started once for many short ParallelFor rounds: Run(count, func) calls func(i) for every i in
+// [0, count) in contiguous blocks, the calling thread taking the first one, and returns when all blocks are
+// done. Between rounds the threads wait on a condition variable. The first exception is rethrown to the caller.
+class WorkerTeam {
+public:
+    explicit WorkerTeam(size_t thread_count = GetThreadCount()) {
+        for (size_t worker = 1; worker < std::max<size_t>(thread_count, 1); ++worker) {
+            threads_.emplace_back([this, worker] { Work(worker); });
+        }
+    }
+    WorkerTeam(const WorkerTeam&) = delete;
+    WorkerTeam& operator = (const WorkerTeam&) = delete;
+    ~WorkerTeam() {
+        {
+            std::lock_guard<std::mutex> guard(mutex_);
+            is_stopped_ = true;
+        }
+        has_round_.notify_all();
+        for (auto& thread : threads_) thread.join();
+    }
+
+    template <typename Func>
+    void Run(size_t count, Func func) {
+        const size_t block_count = std::min(threads_.size() + 1, count);
+        if (block_count <= 1) {
+            for (size_t i = 0; i < count; ++i) func(i);
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> guard(mutex_);
+            block_ = [&func, count, block_count](size_t block) {
+                for (size_t i = count * block / block_count; i < count * (block + 1) / block_count; ++i) func(i);
+            };
+            block_count_ = block_count;
+            pending_blocks_ = block_count - 1;
+            error_ = nullptr;
+            ++round_;
+        }
+        has_round_.notify_all();
+        RunBlock(0);
+        std::unique_lock<std::mutex> lock(mutex_);
+        is_round_done_.wait(lock, [this] { return pending_blocks_ == 0; });
+        block_ = nullptr;
+        if (error_) std::rethrow_exception(error_);
+    }
+
+private:
+    std::mutex mutex_;
+    std::condition_variable has_round_, is_round_done_;
+    std::function<void(size_t)> block_;
+    size_t block_count_{0}, pending_blocks_{0};
+    uint64_t round_{0};
+    bool is_stopped_{false};
+    std::exception_ptr error_;
+    std::vector<std::thread> threads_;
+
+    void RunBlock(size_t block) {
+        try {
+            block_(block);
+        } catch (...) {
+            std::lock_guard<std::mutex> guard(mutex_);
+            if (!error_) error_ = std::current_exception();
+        }
+    }
+    void Work(size_t worker) {
+        uint64_t seen_round = 0;
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (true) {
+            has_round_.wait(lock, [&] { return is_stopped_ || round_ != seen_round; });
+            if (is_stopped_) return;
+            seen_round = round_;
+            // a round of fewer blocks than threads leaves the last threads waiting
+            if (worker >= block_count_) continue;
+            lock.unlock();
+            RunBlock(worker);
+            lock.lock();
+            if (--pending_blocks_ == 0) is_round_done_.notify_one();
+        }
+    }
+};
@@ -1,6 +1,14 @@
 #include "point.h"
 #include <tuple>
 
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define POINTS_HAS_AVX2_KERNEL
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define POINTS_HAS_NEON_KERNEL
+#endif
+
 namespace Points {
     bool operator == (const Point& lhs, const Point& rhs) {
         return std::tie(lhs.latitude, lhs.longitude) == std::tie(rhs.latitude, rhs.longitude);
@@ -9,11 +17,134 @@ namespace Points {
         return output << point.latitude << ' ' << point.longitude;
     }
     double CalcLength(const Point& lhs, const Point& rhs) {
-        using std::sin, std::cos, std::asin, std::sqrt;
-        double sin_la = sin((rhs.latitude - lhs.latitude) * rad_in_degree / 2);
-        double sin_lo = sin((rhs.longitude - lhs.longitude) * rad_in_degree / 2);
-        return 2 * earth_radius * asin(sqrt(sin_la * sin_la
-                                            + sin_lo * sin_lo * cos(rhs.latitude * rad_in_degree)
-                                            * cos(lhs.latitude * rad_in_degree)));
+        return CalcLength(PrepareGeoPoint(lhs), PrepareGeoPoint(rhs));
+    }
+    uint64_t GetHilbertIndex(const Point& point) {
+        constexpr double cells = 4294967295.; // 2^32 - 1 cells per axis
+        uint32_t x = static_cast<uint32_t>((point.longitude + 180) / 360 * cells);
+        uint32_t y = static_cast<uint32_t>((point.latitude + 90) / 180 * cells);
+        uint64_t index = 0;
+        for (uint32_t side = 1u << 31; side > 0; side /= 2) {
+            const uint32_t rx = (x & side) != 0, ry = (y & side) != 0;
+            index += uint64_t{side} * side * ((3 * rx) ^ ry);
+            if (ry == 0) {
+                if (rx == 1) {
+                    x = ~x;
+                    y = ~y;
+                }
+                std::swap(x, y);
+            }
+        }
+        return index;
+    }
+    GeoPoint PrepareGeoPoint(const Point& point) {
+        using std::sin, std::cos;
+        const double lat = point.latitude * rad_in_degree, lon = point.longitude * rad_in_degree;
+        return {sin(lat / 2), cos(lat / 2), sin(lon / 2), cos(lon / 2), cos(lat)};
+    }
+    namespace {
+        double HaversineTerm(double sin_la, double sin_lo, double cos_lat_product) {
+            return sin_la * sin_la + sin_lo * sin_lo * cos_lat_product;
+        }
+        double LengthFromHaversineTerm(double term) {
+            return 2 * earth_radius * std::asin(std::sqrt(term));
+        }
+    }
+    double CalcLength(const GeoPoint& lhs, const GeoPoint& rhs) {
+        double sin_la = rhs.sin_half_lat * lhs.cos_half_lat - rhs.cos_half_lat * lhs.sin_half_lat;
+        double sin_lo = rhs.sin_half_lon * lhs.cos_half_lon - rhs.cos_half_lon * lhs.sin_half_lon;
+        return LengthFromHaversineTerm(HaversineTerm(sin_la, sin_lo, rhs.cos_lat * lhs.cos_lat));
+    }
+
+    size_t GeoTable::Add(const Point& point) {
+        GeoPoint geo_point = PrepareGeoPoint(point);
+        sin_half_lat_.push_back(geo_point.sin_half_lat);
+        cos_half_lat_.push_back(geo_point.cos_half_lat);
+        sin_half_lon_.push_back(geo_point.sin_half_lon);
+        cos_half_lon_.push_back(geo_point.cos_half_lon);
+        cos_lat_.push_back(geo_point.cos_lat);
+        return cos_lat_.size() - 1;
+    }
+    size_t GeoTable::GetSize() const { return cos_lat_.size(); }
+    void GeoTable::Reserve(size_t size) {
+        for (auto* column : {&sin_half_lat_, &cos_half_lat_, &sin_half_lon_, &cos_half_lon_, &cos_lat_}) column->reserve(size);
+    }
+    GeoPoint GeoTable::Get(size_t id) const {
+        return {sin_half_lat_[id], cos_half_lat_[id], sin_half_lon_[id], cos_half_lon_[id], cos_lat_[id]};
+    }
+
+    namespace {
+        // Both kernels fill terms[i] for i < returned count, the tail is left to the scalar loop.
+#ifdef POINTS_HAS_AVX2_KERNEL
+        // the masked gather with a zero source, the plain one leaves its source operand undefined
+        __attribute__((target("avx2")))
+        inline __m256d Gather(const double* column, __m128i index) {
+            const __m256d all_lanes = _mm256_castsi256_pd(_mm256_set1_epi64x(-1));
+            return _mm256_mask_i32gather_pd(_mm256_setzero_pd(), column, index, all_lanes, 8);
+        }
+        __attribute__((target("avx2")))
+        size_t CalcHaversineTermsAvx2(const double* sin_half_lat, const double* cos_half_lat,
+                                      const double* sin_half_lon, const double* cos_half_lon, const double* cos_lat,
+                                      const uint32_t* from, const uint32_t* to, size_t count, double* terms) {
+            size_t i = 0;
+            for (; i + 4 <= count; i += 4) {
+                __m128i lhs = _mm_loadu_si128(reinterpret_cast<const __m128i*>(from + i));
+                __m128i rhs = _mm_loadu_si128(reinterpret_cast<const __m128i*>(to + i));
+                __m256d sin_la = _mm256_sub_pd(
+                        _mm256_mul_pd(Gather(sin_half_lat, rhs), Gather(cos_half_lat, lhs)),
+                        _mm256_mul_pd(Gather(cos_half_lat, rhs), Gather(sin_half_lat, lhs)));
+                __m256d sin_lo = _mm256_sub_pd(
+                        _mm256_mul_pd(Gather(sin_half_lon, rhs), Gather(cos_half_lon, lhs)),
+                        _mm256_mul_pd(Gather(cos_half_lon, rhs), Gather(sin_half_lon, lhs)));
+                __m256d cos_lat_product = _mm256_mul_pd(Gather(cos_lat, rhs), Gather(cos_lat, lhs));
+                __m256d term = _mm256_add_pd(_mm256_mul_pd(sin_la, sin_la),
+                                             _mm256_mul_pd(_mm256_mul_pd(sin_lo, sin_lo), cos_lat_product));
+                _mm256_storeu_pd(terms + i, term);
+            }
+            return i;
+        }
+#endif
+#ifdef POINTS_HAS_NEON_KERNEL
+        size_t CalcHaversineTermsNeon(const double* sin_half_lat, const double* cos_half_lat,
+                                      const double* sin_half_lon, const double* cos_half_lon, const double* cos_lat,
+                                      const uint32_t* from, const uint32_t* to, size_t count, double* terms) {
+            auto gather = [](const double* column, const uint32_t* ids) {
+                return vsetq_lane_f64(column[ids[1]], vdupq_n_f64(column[ids[0]]), 1);
+            };
+            size_t i = 0;
+            for (; i + 2 <= count; i += 2) {
+                const uint32_t* lhs = from + i;
+                const uint32_t* rhs = to + i;
+                float64x2_t sin_la = vsubq_f64(vmulq_f64(gather(sin_half_lat, rhs), gather(cos_half_lat, lhs)),
+                                               vmulq_f64(gather(cos_half_lat, rhs), gather(sin_half_lat, lhs)));
+                float64x2_t sin_lo = vsubq_f64(vmulq_f64(gather(sin_half_lon, rhs), gather(cos_half_lon, lhs)),
+                                               vmulq_f64(gather(cos_half_lon, rhs), gather(sin_half_lon, lhs)));
+                float64x2_t cos_lat_product = vmulq_f64(gather(cos_lat, rhs), gather(cos_lat, lhs));
+                vst1q_f64(terms + i, vaddq_f64(vmulq_f64(sin_la, sin_la), vmulq_f64(vmulq_f64(sin_lo, sin_lo), cos_lat_product)));
+            }
+            return i;
+        }
+#endif
+    }
+
+    void GeoTable::CalcLengths(const uint32_t* from, const uint32_t* to, size_t count, double* lengths) const {
+        size_t done = 0;
+#if defined(POINTS_HAS_AVX2_KERNEL)
+        static const bool has_avx2 = __builtin_cpu_supports("avx2");
+        if (has_avx2) {
+            done = CalcHaversineTermsAvx2(sin_half_lat_.data(), cos_half_lat_.data(), sin_half_lon_.data(), cos_half_lon_.data(),
+                                          cos_lat_.data(), from, to, count, lengths);
+        }
+#elif defined(POINTS_HAS_NEON_KERNEL)
+        done = CalcHaversineTermsNeon(sin_half_lat_.data(), cos_half_lat_.data(), sin_half_lon_.data(), cos_half_lon_.data(),
+                                      cos_lat_.data(), from, to, count, lengths);
+#endif
+        for (size_t i = done; i < count; ++i) {
+            const size_t lhs = from[i], rhs = to[i];
+            double sin_la = sin_half_lat_[rhs] * cos_half_lat_[lhs] - cos_half_lat_[rhs] * sin_half_lat_[lhs];
+            double sin_lo = sin_half_lon_[rhs] * cos_half_lon_[lhs] - cos_half_lon_[rhs] * sin_half_lon_[lhs];
+            lengths[i] = HaversineTerm(sin_la, sin_lo, cos_lat_[rhs] * cos_lat_[lhs]);
+        }
+        for (size_t i = 0; i < count; ++i) lengths[i] = LengthFromHaversineTerm(lengths[i]);
     }
 }
@@ -5,8 +5,10 @@
 
 #endif //CPPCOURSERA_POINT_H
 
+#include <cstdint>
 #include <cstdio>
 #include <complex>
+#include <vector>
 
 namespace Points {
 #define DEFINE_POINT_STRUCTURE(Name) \
@@ -28,4 +30,25 @@ struct Point {
     constexpr double earth_radius = 6371 * 1000;
     constexpr double rad_in_degree = 3.1415926535 / 180;
     double CalcLength(const Point& lhs, const Point& rhs);
+    // position along a Hilbert curve over the whole globe; close points mostly get close values
+    uint64_t GetHilbertIndex(const Point& point);
+    // Haversine terms of a point that don't depend on the other point. With them the distance needs
+    // only multiplications and one asin: sin((b - a) / 2) = sin(b / 2) cos(a / 2) - cos(b / 2) sin(a / 2).
+    struct GeoPoint {
+        double sin_half_lat, cos_half_lat, sin_half_lon, cos_half_lon, cos_lat;
+    };
+    GeoPoint PrepareGeoPoint(const Point& point);
+    double CalcLength(const GeoPoint& lhs, const GeoPoint& rhs);
+    // Prepared points stored column-wise, so the batch kernel loads a vector register per term.
+    class GeoTable {
+    public:
+        size_t Add(const Point& point);
+        size_t GetSize() const;
+        void Reserve(size_t size);
+        GeoPoint Get(size_t id) const;
+        // lengths[i] = distance between points from[i] and to[i]; uses AVX2 or NEON when available
+        void CalcLengths(const uint32_t* from, const uint32_t* to, size_t count, double* lengths) const;
+    private:
+        std::vector<double> sin_half_lat_, cos_half_lat_, sin_half_lon_, cos_half_lon_, cos_lat_;
+    };
 }
\ No newline at end of file
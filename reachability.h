@@ -0,0 +1,184 @@
+#pragma once
+
+#include "graph.h"
+#include "memory_usage.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <numeric>
+#include <utility>
+#include <vector>
+
+namespace Graph {
+
+  // Strongly connected components of a graph with a summary of which components reach which.
+  // Components are numbered by Tarjan's algorithm, so every component only reaches components with smaller ids.
+  // The exact component-to-component reachability is kept as bitsets while the condensation is small;
+  // above that, only weakly connected components separate unreachable pairs.
+  class Reachability {
+  public:
+    static constexpr size_t max_exact_component_count = 4096;
+
+    Reachability() = default;
+    template <typename Weight>
+    explicit Reachability(const DirectedWeightedGraph<Weight>& graph);
+
+    // false means there is no path for sure
+    bool MayReach(VertexId from, VertexId to) const;
+    // number of vertices reachable from the vertex, an upper bound when the reachability is not exact
+    size_t CountReachable(VertexId from) const;
+    size_t GetComponentCount() const;
+    bool IsExact() const;
+    size_t GetMemoryUsage() const;
+
+  private:
+    std::vector<uint32_t> component_by_vertex_;
+    std::vector<uint32_t> weak_component_by_component_;
+    std::vector<size_t> reachable_count_by_component_;
+    size_t words_per_component_ = 0;
+    std::vector<uint64_t> reachable_components_; // a bitset of words_per_component_ words per component
+
+    bool TestBit(uint32_t from, uint32_t to) const {
+      return (reachable_components_[from * words_per_component_ + to / 64] >> (to % 64)) & 1u;
+    }
+  };
+
+
+  template <typename Weight>
+  Reachability::Reachability(const DirectedWeightedGraph<Weight>& graph) {
+    const size_t vertex_count = graph.GetVertexCount();
+    constexpr uint32_t unvisited = UINT32_MAX;
+
+    // iterative Tarjan
+    component_by_vertex_.assign(vertex_count, unvisited);
+    std::vector<uint32_t> index(vertex_count, unvisited), low_link(vertex_count);
+    std::vector<VertexId> stack;
+    std::vector<std::pair<VertexId, size_t>> call_stack; // vertex and the position in its incidence list
+    uint32_t next_index = 0, component_count = 0;
+    for (VertexId root = 0; root < vertex_count; ++root) {
+      if (index[root] != unvisited) {
+        continue;
+      }
+      call_stack.emplace_back(root, 0);
+      index[root] = low_link[root] = next_index++;
+      stack.push_back(root);
+      while (!call_stack.empty()) {
+        auto& [vertex, position] = call_stack.back();
+        const auto edges = graph.GetIncidentEdges(vertex);
+        if (position < static_cast<size_t>(edges.end() - edges.begin())) {
+          const VertexId to = graph.GetEdge(*(edges.begin() + position++)).to;
+          if (index[to] == unvisited) {
+            index[to] = low_link[to] = next_index++;
+            stack.push_back(to);
+            call_stack.emplace_back(to, 0);
+          } else if (component_by_vertex_[to] == unvisited) {
+            low_link[vertex] = std::min(low_link[vertex], index[to]);
+          }
+          continue;
+        }
+        const VertexId finished = vertex;
+        call_stack.pop_back();
+        if (!call_stack.empty()) {
+          low_link[call_stack.back().first] = std::min(low_link[call_stack.back().first], low_link[finished]);
+        }
+        if (low_link[finished] == index[finished]) {
+          VertexId member;
+          do {
+            member = stack.back();
+            stack.pop_back();
+            component_by_vertex_[member] = component_count;
+          } while (member != finished);
+          ++component_count;
+        }
+      }
+    }
+
+    // weakly connected components of the condensation, by union-find
+    std::vector<uint32_t> parent(component_count);
+    std::iota(parent.begin(), parent.end(), 0);
+    auto find = [&parent](uint32_t component) {
+      while (parent[component] != component) {
+        component = parent[component] = parent[parent[component]];
+      }
+      return component;
+    };
+    for (EdgeId edge_id = 0; edge_id < graph.GetEdgeCount(); ++edge_id) {
+      const auto& edge = graph.GetEdge(edge_id);
+      const uint32_t lhs = find(component_by_vertex_[edge.from]), rhs = find(component_by_vertex_[edge.to]);
+      parent[std::max(lhs, rhs)] = std::min(lhs, rhs);
+    }
+    weak_component_by_component_.resize(component_count);
+    std::vector<size_t> component_sizes(component_count), weak_component_sizes(component_count);
+    for (uint32_t component = 0; component < component_count; ++component) {
+      weak_component_by_component_[component] = find(component);
+    }
+    for (VertexId vertex = 0; vertex < vertex_count; ++vertex) {
+      ++component_sizes[component_by_vertex_[vertex]];
+      ++weak_component_sizes[weak_component_by_component_[component_by_vertex_[vertex]]];
+    }
+
+    reachable_count_by_component_.resize(component_count);
+    if (component_count > max_exact_component_count) {
+      for (uint32_t component = 0; component < component_count; ++component) {
+        reachable_count_by_component_[component] = weak_component_sizes[weak_component_by_component_[component]];
+      }
+      return;
+    }
+    // successors have smaller ids, so each component ORs in bitsets that are already complete
+    words_per_component_ = (component_count + 63) / 64;
+    reachable_components_.assign(component_count * words_per_component_, 0);
+    std::vector<std::vector<VertexId>> vertexes_by_component(component_count);
+    for (VertexId vertex = 0; vertex < vertex_count; ++vertex) {
+      vertexes_by_component[component_by_vertex_[vertex]].push_back(vertex);
+    }
+    for (uint32_t component = 0; component < component_count; ++component) {
+      uint64_t* bits = &reachable_components_[component * words_per_component_];
+      bits[component / 64] |= uint64_t{1} << (component % 64);
+      for (VertexId vertex : vertexes_by_component[component]) {
+        for (EdgeId edge_id : graph.GetIncidentEdges(vertex)) {
+          const uint32_t to = component_by_vertex_[graph.GetEdge(edge_id).to];
+          if (to != component && !((bits[to / 64] >> (to % 64)) & 1u)) {
+            const uint64_t* to_bits = &reachable_components_[to * words_per_component_];
+            for (size_t word = 0; word < words_per_component_; ++word) {
+              bits[word] |= to_bits[word];
+            }
+          }
+        }
+      }
+      for (uint32_t to = 0; to <= component; ++to) {
+        if (TestBit(component, to)) {
+          reachable_count_by_component_[component] += component_sizes[to];
+        }
+      }
+    }
+  }
+
+  inline bool Reachability::MayReach(VertexId from, VertexId to) const {
+    const uint32_t from_component = component_by_vertex_[from], to_component = component_by_vertex_[to];
+    if (from_component == to_component) {
+      return true;
+    }
+    if (weak_component_by_component_[from_component] != weak_component_by_component_[to_component] ||
+        from_component < to_component) {
+      return false;
+    }
+    return !IsExact() || TestBit(from_component, to_component);
+  }
+
+  inline size_t Reachability::CountReachable(VertexId from) const {
+    return reachable_count_by_component_[component_by_vertex_[from]];
+  }
+
+  inline size_t Reachability::GetComponentCount() const {
+    return weak_component_by_component_.size();
+  }
+
+  inline bool Reachability::IsExact() const {
+    return words_per_component_ != 0 || weak_component_by_component_.empty();
+  }
+
+  inline size_t Reachability::GetMemoryUsage() const {
+    return Memory::HeapBytes(component_by_vertex_) + Memory::HeapBytes(weak_component_by_component_) +
+           Memory::HeapBytes(reachable_count_by_component_) + Memory::HeapBytes(reachable_components_);
+  }
+}
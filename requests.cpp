@@ -1,125 +1,344 @@
 #include "requests.h"
+#include "json_schema.h"
 #include "utils.h"
 
 #include <algorithm>
+#include <array>
+#include <string_view>
+#include <unordered_map>
 
-#include <iostream>
-#include <iomanip>
+namespace Json {
+    template <>
+    struct Decoder<Points::Point> {
+        static void Decode(const Node& node, Points::Point& point);
+    };
+}
 
 namespace Transport::Requests {
-    Request::Request(Type type) : type(type) {}
-    AddRoutingSettings::AddRoutingSettings(Type type, const Json::Node &body) : ModifyRequest(type) {
-        route_settings.bus_wait_time = body.AsMap().at("bus_wait_time").AsInt();
-        route_settings.bus_velocity = body.AsMap().at("bus_velocity").HoldsInt() ? body.AsMap().at("bus_velocity").AsInt() : body.AsMap().at("bus_velocity").AsDouble();
-        route_settings.bus_velocity *= 50. / 3; // км/ч -> м/мин
-    }
-    void AddRoutingSettings::Process(TransportDatabase &tdb) const { tdb.AddRoutingSettings(route_settings); }
-    AddStopRequest::AddStopRequest(Type type, const Json::Node& body) : ModifyRequest(type) {
-        stop = std::make_shared<Stop>();
-        stop->name = body.AsMap().at("name").AsString();
-        const auto& latitude_node = body.AsMap().at("latitude"), longitude_node = body.AsMap().at("longitude");
-        stop->location.latitude.value = latitude_node.HoldsInt() ? latitude_node.AsInt() : latitude_node.AsDouble();
-        stop->location.longitude.value = longitude_node.HoldsInt() ? longitude_node.AsInt() : longitude_node.AsDouble();
-        for (const auto& [stop_name, dist_node] : body.AsMap().at("road_distances").AsMap()) {
-            stop->distance_to_stops[stop_name] = dist_node.AsInt();
+    namespace {
+        using Json::Optional;
+        using Json::Required;
+
+        // coordinates of a point given by the fields of the object itself
+        template <typename Object, Points::Point Object::* point>
+        void DecodeLatitude(const Json::Node& node, Object& object) {
+            (object.*point).latitude.value = Json::Decode<double>(node);
         }
-    }
-    void AddStopRequest::Process(TransportDatabase &tdb) const { tdb.AddStop(stop); }
-    AddBusRequest::AddBusRequest(Type type, const Json::Node& body) : ModifyRequest(type) {
-        bus = std::make_shared<Bus>();
-        bus->number = body.AsMap().at("name").AsString();
-        BusRoute::Type bus_type = body.AsMap().at("is_roundtrip").AsBool() ? BusRoute::Type::Circular : BusRoute::Type::Direct;
-        std::vector<StopName> stop_names;
-        for (const auto& stop_node : body.AsMap().at("stops").AsArray()) {
-            stop_names.push_back(stop_node.AsString());
+        template <typename Object, Points::Point Object::* point>
+        void DecodeLongitude(const Json::Node& node, Object& object) {
+            (object.*point).longitude.value = Json::Decode<double>(node);
+        }
+        struct PointFields {
+            Points::Point point;
+        };
+        const auto point_schema = Json::MakeSchema<PointFields>(
+                Required("latitude", &DecodeLatitude<PointFields, &PointFields::point>),
+                Required("longitude", &DecodeLongitude<PointFields, &PointFields::point>));
+
+        template <typename Enum, size_t N>
+        void DecodeName(const Json::Node& node, Enum& value, const std::pair<std::string_view, Enum> (&names)[N],
+                        const std::string& kind) {
+            const std::string name = Json::Decode<std::string>(node);
+            for (const auto& [known_name, known_value] : names) {
+                if (known_name == name) {
+                    value = known_value;
+                    return;
+                }
+            }
+            throw Json::SchemaError("", "unknown " + kind + " " + name);
         }
-        bus->route = BusRoute {bus_type, stop_names};
-    }
-    void InitializeRouterRequest::Process(TransportDatabase &tdb) const { tdb.InitializeRouter(); }
-    void AddBusRequest::Process(TransportDatabase &tdb) const { tdb.AddBus(bus); }
-    GetBusRequest::GetBusRequest(Type type, const Json::Node& body) : ReadRequest(type, body) {
-        bus_number = body.AsMap().at("name").AsString();
-    }
-    Json::Node GetBusRequest::Process(const TransportDatabase &tdb) const { return tdb.GetBus(bus_number, id); }
-    GetStopRequest::GetStopRequest(Type type, const Json::Node& body) : ReadRequest(type, body) {
-        stop_name = body.AsMap().at("name").AsString();
-    }
-    Json::Node GetStopRequest::Process(const TransportDatabase &tdb) const { return tdb.GetStop(stop_name, id); }
-    GetRouteRequest::GetRouteRequest(Type type, const Json::Node &body) : ReadRequest(type, body) {
-        from = body.AsMap().at("from").AsString();
-        to = body.AsMap().at("to").AsString();
-    }
-    Json::Node GetRouteRequest::Process(const TransportDatabase &tdb) const { return tdb.GetRoute(from, to, id); }
-    RequestHolder ParseRequest(Request::Type type, const Json::Node& request_body) {
-        switch (type) {
-            case Request::Type::AddRoutingSettings:
-                return std::make_unique<AddRoutingSettings>(type, request_body);
-            case Request::Type::AddStop:
-                return std::make_unique<AddStopRequest>(type, request_body);
-            case Request::Type::AddBus:
-                return std::make_unique<AddBusRequest>(type, request_body);
-            case Request::Type::GetBus:
-                return std::make_unique<GetBusRequest>(type, request_body);
-            case Request::Type::GetStop:
-                return std::make_unique<GetStopRequest>(type, request_body);
-            case Request::Type::GetRoute:
-                return std::make_unique<GetRouteRequest>(type, request_body);
-            default:
-                throw std::runtime_error("unknown type parameter");
+        constexpr std::pair<std::string_view, RouteSettings::Engine> engine_names[] = {
+                {"table", RouteSettings::Engine::Table}, {"dijkstra", RouteSettings::Engine::Dijkstra},
+                {"alt", RouteSettings::Engine::Alt}, {"hub_labels", RouteSettings::Engine::HubLabels},
+                {"overlay", RouteSettings::Engine::Overlay}};
+        constexpr std::pair<std::string_view, RouteSettings::TableAlgorithm> table_algorithm_names[] = {
+                {"dijkstra", RouteSettings::TableAlgorithm::Dijkstra},
+                {"delta_stepping", RouteSettings::TableAlgorithm::DeltaStepping}};
+        constexpr std::pair<std::string_view, RouteSettings::VertexOrder> vertex_order_names[] = {
+                {"none", RouteSettings::VertexOrder::None}, {"geographic", RouteSettings::VertexOrder::Geographic}};
+
+        const auto route_settings_schema = Json::MakeSchema<RouteSettings>(
+                Required("bus_wait_time", &RouteSettings::bus_wait_time),
+                Required<RouteSettings>("bus_velocity", [](const Json::Node& node, RouteSettings& settings) {
+                    settings.bus_velocity = Json::Decode<double>(node) * 50. / 3; // км/ч -> м/мин
+                }),
+                Optional<RouteSettings>("pedestrian_velocity", [](const Json::Node& node, RouteSettings& settings) {
+                    settings.pedestrian_velocity = Json::Decode<double>(node) * 50. / 3;
+                }),
+                Optional<RouteSettings>("engine", [](const Json::Node& node, RouteSettings& settings) {
+                    DecodeName(node, settings.engine, engine_names, "routing engine");
+                }),
+                Optional<RouteSettings>("table_algorithm", [](const Json::Node& node, RouteSettings& settings) {
+                    DecodeName(node, settings.table_algorithm, table_algorithm_names, "table algorithm");
+                }),
+                Optional<RouteSettings>("vertex_order", [](const Json::Node& node, RouteSettings& settings) {
+                    DecodeName(node, settings.vertex_order, vertex_order_names, "vertex order");
+                }),
+                Optional("snap_stops_count", &RouteSettings::snap_stops_count),
+                Optional("landmark_count", &RouteSettings::landmark_count),
+                Optional("overlay_cell_size", &RouteSettings::overlay_cell_size),
+                Optional("route_cache_size", &RouteSettings::route_cache_size));
+
+        const auto memory_settings_schema = Json::MakeSchema<MemorySettings>(
+                Optional<MemorySettings>("budget_mb", [](const Json::Node& node, MemorySettings& settings) {
+                    settings.budget_bytes = static_cast<size_t>(Json::Decode<double>(node) * 1024 * 1024);
+                }),
+                Optional("log_phases", &MemorySettings::log_phases));
+
+        const auto stop_schema = Json::MakeSchema<Stop>(
+                Required("name", &Stop::name),
+                Required("latitude", &DecodeLatitude<Stop, &Stop::location>),
+                Required("longitude", &DecodeLongitude<Stop, &Stop::location>),
+                Required("road_distances", &Stop::distance_to_stops));
+
+        struct BusFields {
+            BusNumber name;
+            std::vector<StopName> stops;
+            bool is_roundtrip{false};
+        };
+        const auto bus_schema = Json::MakeSchema<BusFields>(
+                Required("name", &BusFields::name),
+                Required("stops", &BusFields::stops),
+                Required("is_roundtrip", &BusFields::is_roundtrip));
+
+        const auto bus_request_schema = Json::MakeSchema<GetBusRequest>(
+                Required("id", &GetBusRequest::id), Required("name", &GetBusRequest::bus_number));
+        const auto stop_request_schema = Json::MakeSchema<GetStopRequest>(
+                Required("id", &GetStopRequest::id), Required("name", &GetStopRequest::stop_name));
+        const auto route_budget_schema = Json::MakeSchema<RouteBudget>(
+                Optional("settled_vertices", &RouteBudget::settled_vertices),
+                Optional<RouteBudget>("microseconds", [](const Json::Node& node, RouteBudget& budget) {
+                    budget.microseconds = Json::Decode<size_t>(node);
+                }));
+        const auto route_request_schema = Json::MakeSchema<GetRouteRequest>(
+                Required("id", &GetRouteRequest::id), Required("from", &GetRouteRequest::from),
+                Required("to", &GetRouteRequest::to),
+                Optional<GetRouteRequest>("budget", [](const Json::Node& node, GetRouteRequest& request) {
+                    route_budget_schema.Decode(node, request.budget);
+                }));
+        const auto point_route_request_schema = Json::MakeSchema<GetPointRouteRequest>(
+                Required("id", &GetPointRouteRequest::id), Required("from", &GetPointRouteRequest::from),
+                Required("to", &GetPointRouteRequest::to));
+        const auto matrix_request_schema = Json::MakeSchema<GetMatrixRequest>(
+                Required("id", &GetMatrixRequest::id), Required("from", &GetMatrixRequest::from),
+                Required("to", &GetMatrixRequest::to));
+        const auto reachable_stops_request_schema = Json::MakeSchema<GetReachableStopsRequest>(
+                Required("id", &GetReachableStopsRequest::id), Required("from", &GetReachableStopsRequest::from),
+                Required("time", &GetReachableStopsRequest::max_time));
+        const auto nearest_stops_request_schema = Json::MakeSchema<GetNearestStopsRequest>(
+                Required("id", &GetNearestStopsRequest::id),
+                Required("latitude", &DecodeLatitude<GetNearestStopsRequest, &GetNearestStopsRequest::point>),
+                Required("longitude", &DecodeLongitude<GetNearestStopsRequest, &GetNearestStopsRequest::point>),
+                Required("count", &GetNearestStopsRequest::count));
+        const auto stops_in_radius_request_schema = Json::MakeSchema<GetStopsInRadiusRequest>(
+                Required("id", &GetStopsInRadiusRequest::id),
+                Required("latitude", &DecodeLatitude<GetStopsInRadiusRequest, &GetStopsInRadiusRequest::point>),
+                Required("longitude", &DecodeLongitude<GetStopsInRadiusRequest, &GetStopsInRadiusRequest::point>),
+                Required("radius", &GetStopsInRadiusRequest::radius));
+        const auto memory_usage_request_schema = Json::MakeSchema<GetMemoryUsageRequest>(
+                Required("id", &GetMemoryUsageRequest::id));
+        const auto metrics_request_schema = Json::MakeSchema<GetMetricsRequest>(
+                Required("id", &GetMetricsRequest::id));
+    }
+    std::string ParseType(const Json::Node& request_json) {
+        if (!request_json.HoldsMap() || request_json.AsMap().count("type") == 0) throw Json::SchemaError("type", "is missing");
+        std::string type;
+        Json::DecodeField("type", [&] { type = Json::Decode<std::string>(request_json.AsMap().at("type")); });
+        return type;
+    }
+    StopHandler ParseStop(const Json::Node& request_json) {
+        StopHandler stop = std::make_shared<Stop>();
+        stop_schema.Decode(request_json, *stop);
+        return stop;
+    }
+    BusHandler ParseBus(const Json::Node& request_json) {
+        BusFields fields = bus_schema.Decode(request_json);
+        BusHandler bus = std::make_shared<Bus>();
+        bus->number = std::move(fields.name);
+        bus->route = BusRoute {fields.is_roundtrip ? BusRoute::Type::Circular : BusRoute::Type::Direct, std::move(fields.stops)};
+        return bus;
+    }
+    StatRequest ParseStatRequest(const Json::Node& request_json) {
+        const std::string type = ParseType(request_json);
+        if (type == "Stop") {
+            return stop_request_schema.Decode(request_json);
+        } else if (type == "Bus") {
+            return bus_request_schema.Decode(request_json);
+        } else if (type == "Route") {
+            const auto from = request_json.AsMap().find("from");
+            if (from != request_json.AsMap().end() && from->second.HoldsMap()) return point_route_request_schema.Decode(request_json);
+            return route_request_schema.Decode(request_json);
+        } else if (type == "MemoryUsage") {
+            return memory_usage_request_schema.Decode(request_json);
+        } else if (type == "Metrics") {
+            return metrics_request_schema.Decode(request_json);
+        } else if (type == "Matrix") {
+            return matrix_request_schema.Decode(request_json);
+        } else if (type == "Reachable") {
+            return reachable_stops_request_schema.Decode(request_json);
+        } else if (type == "NearestStops") {
+            return nearest_stops_request_schema.Decode(request_json);
+        } else if (type == "StopsInRadius") {
+            return stops_in_radius_request_schema.Decode(request_json);
         }
+        throw std::invalid_argument("unknown type of request");
+    }
+    Json::Node Process(const GetBusRequest& request, const TransportDatabase& tdb) {
+        return tdb.GetBus(request.bus_number, request.id);
+    }
+    Json::Node Process(const GetStopRequest& request, const TransportDatabase& tdb) {
+        return tdb.GetStop(request.stop_name, request.id);
+    }
+    Json::Node Process(const GetRouteRequest& request, const TransportDatabase& tdb) {
+        return tdb.GetRoute(request.from, request.to, request.id, request.budget);
+    }
+    Json::Node Process(const GetPointRouteRequest& request, const TransportDatabase& tdb) {
+        return tdb.GetRoute(request.from, request.to, request.id);
+    }
+    Json::Node Process(const GetMatrixRequest& request, const TransportDatabase& tdb) {
+        return tdb.GetMatrix(request.from, request.to, request.id);
+    }
+    Json::Node Process(const GetReachableStopsRequest& request, const TransportDatabase& tdb) {
+        return tdb.GetReachableStops(request.from, request.max_time, request.id);
+    }
+    Json::Node Process(const GetNearestStopsRequest& request, const TransportDatabase& tdb) {
+        return tdb.GetNearestStops(request.point, request.count, request.id);
+    }
+    Json::Node Process(const GetStopsInRadiusRequest& request, const TransportDatabase& tdb) {
+        return tdb.GetStopsInRadius(request.point, request.radius, request.id);
     }
-    std::vector<RequestHolder> ParseRequests(const Json::Document& document) {
-        std::vector<RequestHolder> requests;
+    Json::Node Process(const GetMemoryUsageRequest& request, const TransportDatabase& tdb) {
+        return tdb.GetMemoryUsage(request.id);
+    }
+    Json::Node Process(const GetMetricsRequest& request, const TransportDatabase& tdb) {
+        return tdb.GetMetrics(request.id);
+    }
+    Json::Node Process(const StatRequest& request, const TransportDatabase& tdb) {
+        return std::visit([&tdb](const auto& typed_request) { return Process(typed_request, tdb); }, request);
+    }
+    bool IsRouteSearch(const StatRequest& request) {
+        return std::holds_alternative<GetRouteRequest>(request) || std::holds_alternative<GetPointRouteRequest>(request) ||
+               std::holds_alternative<GetMatrixRequest>(request) || std::holds_alternative<GetReachableStopsRequest>(request);
+    }
+    RequestBatches ParseBaseRequests(const Json::Document& document) {
+        RequestBatches requests;
         const auto& root = document.GetRoot();
         if (root.AsMap().count("routing_settings") == 0) throw std::invalid_argument("Json document doesn't contains routing_settings");
         if (root.AsMap().count("base_requests") == 0) throw std::invalid_argument("Json document doesn't contains base_requests");
-        if (root.AsMap().count("stat_requests") == 0) throw std::invalid_argument("Json document doesn't contains stat_requests");
-        for (const auto& request_json : root.AsMap().at("base_requests").AsArray()) {
-            auto request_json_map = request_json.AsMap();
-            std::string type = request_json_map.at("type").AsString();
-            if (type == "Stop") {
-                requests.push_back(ParseRequest(Request::Type::AddStop, request_json));
-            } else if (type == "Bus") {
-                requests.push_back(ParseRequest(Request::Type::AddBus, request_json));
-            } else {
-                throw std::invalid_argument("unknown type of request");
-            }
+        std::vector<std::variant<StopHandler, BusHandler>> base_objects;
+        const auto& base_requests = root.AsMap().at("base_requests").AsArray();
+        for (size_t i = 0; i < base_requests.size(); ++i) {
+            Json::DecodeField("base_requests[" + std::to_string(i) + "]", [&] {
+                const std::string type = ParseType(base_requests[i]);
+                if (type == "Stop") {
+                    base_objects.emplace_back(ParseStop(base_requests[i]));
+                } else if (type == "Bus") {
+                    base_objects.emplace_back(ParseBus(base_requests[i]));
+                } else {
+                    throw std::invalid_argument("unknown type of request");
+                }
+            });
         }
-        std::partition(requests.begin(), requests.end(), [](const RequestHolder& lhs){
-            return lhs->type == Request::Type::AddStop;
+        // the order of stops and buses decides which of equal-time routes is found, keep the one
+        // the partition of the mixed list has always given
+        std::partition(base_objects.begin(), base_objects.end(), [](const auto& object) {
+            return std::holds_alternative<StopHandler>(object);
         });
-        requests.push_back(ParseRequest(Request::Type::AddRoutingSettings, root.AsMap().at("routing_settings").AsMap()));
-        requests.push_back(std::make_unique<InitializeRouterRequest>(Request::Type::InitializeRouter));
+        for (auto& object : base_objects) {
+            if (auto* stop = std::get_if<StopHandler>(&object)) requests.stops.push_back(std::move(*stop));
+            else requests.buses.push_back(std::move(std::get<BusHandler>(object)));
+        }
+        if (root.AsMap().count("memory_settings") != 0)
+            Json::DecodeField("memory_settings", [&] {
+                requests.memory_settings = memory_settings_schema.Decode(root.AsMap().at("memory_settings"));
+            });
+        Json::DecodeField("routing_settings", [&] {
+            requests.route_settings = route_settings_schema.Decode(root.AsMap().at("routing_settings"));
+        });
+        return requests;
+    }
+    RequestBatches ParseRequests(const Json::Document& document) {
+        const auto& root = document.GetRoot();
+        if (root.AsMap().count("stat_requests") == 0) throw std::invalid_argument("Json document doesn't contains stat_requests");
+        RequestBatches requests = ParseBaseRequests(document);
         for (const auto& request_json : root.AsMap().at("stat_requests").AsArray()) {
-            auto request_json_map = request_json.AsMap();
-            std::string type = request_json_map.at("type").AsString();
-            if (type == "Stop") {
-                requests.push_back(ParseRequest(Request::Type::GetStop, request_json));
-            } else if (type == "Bus") {
-                requests.push_back(ParseRequest(Request::Type::GetBus, request_json));
-            } else if (type == "Route") {
-                requests.push_back(ParseRequest(Request::Type::GetRoute, request_json));
-            } else {
-                throw std::invalid_argument("unknown type of request");
-            }
+            StatRequest request;
+            Json::DecodeField("stat_requests[" + std::to_string(requests.stat_request_count) + "]", [&] {
+                request = ParseStatRequest(request_json);
+            });
+            std::visit([&requests](auto&& typed_request) {
+                using Request = std::decay_t<decltype(typed_request)>;
+                std::get<Batch<Request>>(requests.stat_requests).emplace_back(std::move(typed_request), requests.stat_request_count);
+            }, std::move(request));
+            ++requests.stat_request_count;
         }
         return requests;
     }
-    Json::Document ProcessRequests(const std::vector<RequestHolder>& requests, TransportDatabase& tdb) {
-        std::vector<Json::Node> request_results;
-        for (const auto& request : requests) {
-            if (request->type == Request::Type::AddStop || request->type == Request::Type::AddBus ||
-                request->type == Request::Type::AddRoutingSettings || request->type == Request::Type::InitializeRouter) {
-                const auto& req = dynamic_cast<const ModifyRequest&>(*request);
-                req.Process(tdb);
-            } else {
-                const auto& req = dynamic_cast<const ReadRequest<Json::Node>&>(*request);
-                request_results.push_back(req.Process(tdb));
+    RequestId GetRequestId(const StatRequest& request) {
+        return std::visit([](const auto& typed_request) { return typed_request.id; }, request);
+    }
+    namespace {
+        template <typename Request>
+        void ProcessBatch(const Batch<Request>& requests, size_t begin, size_t end,
+                          const TransportDatabase& tdb, std::vector<Json::Node>& request_results) {
+            for (size_t i = begin; i < end; ++i) {
+                request_results[requests[i].second] = Process(requests[i].first, tdb);
+            }
+        }
+        // Route requests are answered per origin stop, so that an on-demand engine searches once per origin.
+        // A request with a budget gets a search of its own.
+        void ProcessBatch(const Batch<GetRouteRequest>& requests, size_t begin, size_t end,
+                          const TransportDatabase& tdb, std::vector<Json::Node>& request_results) {
+            std::unordered_map<std::string_view, std::vector<size_t>> requests_by_origin;
+            for (size_t i = begin; i < end; ++i) {
+                const RouteBudget& budget = requests[i].first.budget;
+                if (budget.settled_vertices || budget.microseconds) request_results[requests[i].second] = Process(requests[i].first, tdb);
+                else requests_by_origin[requests[i].first.from].push_back(i);
+            }
+            for (const auto& [from, indexes] : requests_by_origin) {
+                std::vector<std::pair<StopName, size_t>> to_with_ids;
+                for (size_t i : indexes) to_with_ids.emplace_back(requests[i].first.to, requests[i].first.id);
+                std::vector<Json::Node> results = tdb.GetRoutes(StopName(from), to_with_ids);
+                for (size_t i = 0; i < indexes.size(); ++i) request_results[requests[indexes[i]].second] = std::move(results[i]);
             }
         }
+    }
+    Json::Document ProcessRequests(const RequestBatches& requests, TransportDatabase& tdb) {
+        for (const auto& stop : requests.stops) tdb.AddStop(stop);
+        for (const auto& bus : requests.buses) tdb.AddBus(bus);
+        if (requests.memory_settings) tdb.AddMemorySettings(*requests.memory_settings);
+        tdb.AddRoutingSettings(requests.route_settings);
+        tdb.InitializeRouter();
+
+        // MemoryUsage and Metrics answer with the state the requests before them left: the batches run in
+        // segments that end at each of them, and their own batches run last in a segment
+        std::vector<size_t> segment_ends;
+        for (const auto& [_, position] : std::get<Batch<GetMemoryUsageRequest>>(requests.stat_requests)) segment_ends.push_back(position + 1);
+        for (const auto& [_, position] : std::get<Batch<GetMetricsRequest>>(requests.stat_requests)) segment_ends.push_back(position + 1);
+        std::sort(segment_ends.begin(), segment_ends.end());
+        segment_ends.push_back(requests.stat_request_count);
+
+        std::vector<Json::Node> request_results(requests.stat_request_count);
+        std::array<size_t, std::variant_size_v<StatRequest>> batch_begins{};
+        for (size_t segment_end : segment_ends) {
+            std::apply([&](const auto&... batches) {
+                size_t batch_index = 0;
+                auto process = [&](const auto& batch) {
+                    size_t& begin = batch_begins[batch_index++];
+                    size_t end = begin;
+                    while (end < batch.size() && batch[end].second < segment_end) ++end;
+                    ProcessBatch(batch, begin, end, tdb, request_results);
+                    begin = end;
+                };
+                (process(batches), ...);
+            }, requests.stat_requests);
+        }
         return Json::Document(Json::Node(request_results));
     }
-    std::ostream& operator << (std::ostream& output, const Request::Type& type) {
-        return output << static_cast<int>(type);
+}
+
+namespace Json {
+    void Decoder<Points::Point>::Decode(const Node& node, Points::Point& point) {
+        point = Transport::Requests::point_schema.Decode(node).point;
     }
-}
\ No newline at end of file
+}
@@ -8,69 +8,102 @@
 #include "transport_database.h"
 #include "json.h"
 
+#include <optional>
+#include <tuple>
+#include <utility>
+#include <variant>
+#include <vector>
+
 namespace Transport::Requests {
     using RequestId = size_t;
-    struct Request {
-        enum class Type {
-            AddRoutingSettings,
-            AddStop,
-            AddBus,
-            InitializeRouter,
-            GetBus,
-            GetStop,
-            GetRoute
-        } type;
-        explicit Request(Type type);
-        virtual ~Request() = default;
+    struct GetBusRequest {
+        RequestId id{0};
+        BusNumber bus_number;
     };
-    template <typename ResultType>
-    struct ReadRequest : Request {
-        using Request::Request;
-        ReadRequest(Type type, const Json::Node& body) : Request(type), id(body.AsMap().at("id").AsInt()) {}
-        virtual ResultType Process(const TransportDatabase& tdb) const = 0;
-        const RequestId id{0};
+    struct GetStopRequest {
+        RequestId id{0};
+        StopName stop_name;
     };
-    struct ModifyRequest : Request {
-        using Request::Request;
-        virtual void Process(TransportDatabase& tdb) const = 0;
+    struct GetRouteRequest {
+        RequestId id{0};
+        StopName from, to;
+        RouteBudget budget;
     };
-    struct AddRoutingSettings : ModifyRequest {
-        AddRoutingSettings(Type type, const Json::Node& body);
-        void Process(TransportDatabase& tdb) const override;
-        RouteSettings route_settings;
+    struct GetPointRouteRequest {
+        RequestId id{0};
+        Points::Point from, to;
     };
-    struct AddStopRequest : ModifyRequest {
-        AddStopRequest(Type type, const Json::Node& body);
-        void Process(TransportDatabase& tdb) const override;
-        StopHandler stop;
+    struct GetMatrixRequest {
+        RequestId id{0};
+        std::vector<StopName> from, to;
     };
-    struct AddBusRequest : ModifyRequest {
-        AddBusRequest(Type type, const Json::Node& body);
-        void Process(TransportDatabase& tdb) const override;
-        BusHandler bus;
+    struct GetReachableStopsRequest {
+        RequestId id{0};
+        StopName from;
+        double max_time{0};
     };
-    struct InitializeRouterRequest : ModifyRequest {
-        using ModifyRequest::ModifyRequest;
-        void Process(TransportDatabase& tdb) const override;
+    struct GetNearestStopsRequest {
+        RequestId id{0};
+        Points::Point point;
+        size_t count{0};
     };
-    struct GetBusRequest : ReadRequest<Json::Node> {
-        GetBusRequest(Type type, const Json::Node& body);
-        Json::Node Process(const TransportDatabase& tdb) const override;
-        BusNumber bus_number;
+    struct GetStopsInRadiusRequest {
+        RequestId id{0};
+        Points::Point point;
+        double radius{0};
     };
-    struct GetStopRequest : ReadRequest<Json::Node> {
-        GetStopRequest(Type type, const Json::Node& body);
-        Json::Node Process(const TransportDatabase& tdb) const override;
-        StopName stop_name;
+    struct GetMemoryUsageRequest {
+        RequestId id{0};
     };
-    struct GetRouteRequest : ReadRequest<Json::Node> {
-        GetRouteRequest(Type type, const Json::Node& body);
-        Json::Node Process(const TransportDatabase& tdb) const override;
-        StopName from, to;
+    struct GetMetricsRequest {
+        RequestId id{0};
+    };
+    // MemoryUsage and Metrics stay last: they report what the queries before them left in the database
+    using StatRequest = std::variant<GetBusRequest, GetStopRequest, GetRouteRequest, GetPointRouteRequest,
+                                     GetMatrixRequest, GetReachableStopsRequest, GetNearestStopsRequest,
+                                     GetStopsInRadiusRequest, GetMemoryUsageRequest, GetMetricsRequest>;
+    // the decoders of single requests throw Json::SchemaError naming the field that doesn't fit
+    std::string ParseType(const Json::Node& request_json);
+    StopHandler ParseStop(const Json::Node& request_json);
+    BusHandler ParseBus(const Json::Node& request_json);
+    StatRequest ParseStatRequest(const Json::Node& request_json);
+
+    Json::Node Process(const GetBusRequest& request, const TransportDatabase& tdb);
+    Json::Node Process(const GetStopRequest& request, const TransportDatabase& tdb);
+    Json::Node Process(const GetRouteRequest& request, const TransportDatabase& tdb);
+    Json::Node Process(const GetPointRouteRequest& request, const TransportDatabase& tdb);
+    Json::Node Process(const GetMatrixRequest& request, const TransportDatabase& tdb);
+    Json::Node Process(const GetReachableStopsRequest& request, const TransportDatabase& tdb);
+    Json::Node Process(const GetNearestStopsRequest& request, const TransportDatabase& tdb);
+    Json::Node Process(const GetStopsInRadiusRequest& request, const TransportDatabase& tdb);
+    Json::Node Process(const GetMemoryUsageRequest& request, const TransportDatabase& tdb);
+    Json::Node Process(const GetMetricsRequest& request, const TransportDatabase& tdb);
+    Json::Node Process(const StatRequest& request, const TransportDatabase& tdb);
+    // Route, Matrix and Reachable requests search the route graph
+    bool IsRouteSearch(const StatRequest& request);
+    RequestId GetRequestId(const StatRequest& request);
+
+    // requests of one type, each with its position among the responses
+    template <typename Request>
+    using Batch = std::vector<std::pair<Request, size_t>>;
+    template <typename Variant>
+    struct BatchesOf;
+    template <typename... Request>
+    struct BatchesOf<std::variant<Request...>> {
+        using type = std::tuple<Batch<Request>...>;
+    };
+
+    // The requests of a document stored by type: the base is applied as stops, buses and settings,
+    // and stat requests are answered a whole batch of a type at a time.
+    struct RequestBatches {
+        std::vector<StopHandler> stops;
+        std::vector<BusHandler> buses;
+        std::optional<MemorySettings> memory_settings;
+        RouteSettings route_settings;
+        BatchesOf<StatRequest>::type stat_requests;
+        size_t stat_request_count{0};
     };
-    using RequestHolder = std::unique_ptr<Request>;
-    RequestHolder ParseRequest(Request::Type type, const Json::Node& request_body);
-    std::vector<RequestHolder> ParseRequests(const Json::Document&);
-    Json::Document ProcessRequests(const std::vector<RequestHolder>&, TransportDatabase&);
-    std::ostream& operator << (std::ostream&, const Request::Type&);
-}
\ No newline at end of file
+    RequestBatches ParseBaseRequests(const Json::Document&);
+    RequestBatches ParseRequests(const Json::Document&);
+    Json::Document ProcessRequests(const RequestBatches&, TransportDatabase&);
+}
@@ -0,0 +1,77 @@
+#include "route_cache.h"
+#include "memory_usage.h"
+
+namespace Transport {
+    namespace {
+        size_t GetResponseBytes(const RouteCache::Response& response);
+        // estimated the way Memory::HeapBytes estimates the containers
+        size_t GetNodeBytes(const Json::Node& node) {
+            if (node.HoldsString()) return Memory::HeapBytes(node.AsString());
+            if (node.HoldsMap()) return GetResponseBytes(node.AsMap());
+            if (!node.HoldsArray()) return 0;
+            size_t result = node.AsArray().capacity() * sizeof(Json::Node);
+            for (const auto& item : node.AsArray()) result += GetNodeBytes(item);
+            return result;
+        }
+        size_t GetResponseBytes(const RouteCache::Response& response) {
+            size_t result = response.size() * (sizeof(RouteCache::Response::value_type) + Memory::tree_node_overhead);
+            for (const auto& [key, value] : response) result += Memory::HeapBytes(key) + GetNodeBytes(value);
+            return result;
+        }
+    }
+
+    RouteCache::RouteCache(size_t capacity) : shard_capacity_((capacity + shard_count - 1) / shard_count) {}
+    uint64_t RouteCache::MakeKey(size_t from, size_t to) { return (static_cast<uint64_t>(from) << 32u) | to; }
+    RouteCache::Shard& RouteCache::GetShard(uint64_t key) {
+        return shards_[std::hash<uint64_t>{}(key * 0x9e3779b97f4a7c15ull) % shard_count];
+    }
+    std::shared_ptr<const RouteCache::Response> RouteCache::Find(size_t from, size_t to) {
+        const uint64_t key = MakeKey(from, to);
+        Shard& shard = GetShard(key);
+        std::lock_guard<std::mutex> guard(shard.mutex);
+        auto it = shard.entry_by_key.find(key);
+        if (it == shard.entry_by_key.end()) {
+            ++misses_;
+            return nullptr;
+        }
+        ++hits_;
+        shard.entries.splice(shard.entries.begin(), shard.entries, it->second);
+        return it->second->response;
+    }
+    void RouteCache::Insert(size_t from, size_t to, Response response) {
+        if (shard_capacity_ == 0) return;
+        const uint64_t key = MakeKey(from, to);
+        // the payload is measured and shared before the lock is taken
+        const size_t response_bytes = sizeof(Response) + 2 * sizeof(void*) + GetResponseBytes(response);
+        auto shared_response = std::make_shared<const Response>(std::move(response));
+        Shard& shard = GetShard(key);
+        std::lock_guard<std::mutex> guard(shard.mutex);
+        if (shard.entry_by_key.count(key) != 0) return;
+        shard.entries.push_front({key, std::move(shared_response), response_bytes});
+        shard.entry_by_key[key] = shard.entries.begin();
+        shard.response_bytes += response_bytes;
+        if (shard.entries.size() > shard_capacity_) {
+            shard.response_bytes -= shard.entries.back().response_bytes;
+            shard.entry_by_key.erase(shard.entries.back().key);
+            shard.entries.pop_back();
+        }
+    }
+    RouteCache::Metrics RouteCache::GetMetrics() const {
+        Metrics metrics{hits_, misses_, 0};
+        for (const auto& shard : shards_) {
+            std::lock_guard<std::mutex> guard(shard.mutex);
+            metrics.size += shard.entries.size();
+        }
+        return metrics;
+    }
+    // responses still held by a query after their eviction are not counted
+    size_t RouteCache::GetMemoryUsage() const {
+        size_t result = 0;
+        for (const auto& shard : shards_) {
+            std::lock_guard<std::mutex> guard(shard.mutex);
+            result += shard.entries.size() * (sizeof(Entries::value_type) + 2 * sizeof(void*)) +
+                      Memory::HeapBytes(shard.entry_by_key) + shard.response_bytes;
+        }
+        return result;
+    }
+}
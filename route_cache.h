@@ -0,0 +1,57 @@
+#pragma once
+
+#ifndef CPPCOURSERA_ROUTE_CACHE_H
+#define CPPCOURSERA_ROUTE_CACHE_H
+
+#endif //CPPCOURSERA_ROUTE_CACHE_H
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "json.h"
+
+namespace Transport {
+    // Bounded LRU cache of built Route responses keyed by the (from, to) stop ids.
+    // Keys are spread over independently locked shards, so concurrent queries rarely wait for each other.
+    // Responses are shared and immutable: a lookup copies only a pointer under the lock.
+    class RouteCache {
+    public:
+        using Response = std::map<std::string, Json::Node>;
+        struct Metrics {
+            uint64_t hits{0}, misses{0};
+            size_t size{0};
+        };
+        // the capacity is rounded up to a multiple of the shard count
+        explicit RouteCache(size_t capacity);
+        std::shared_ptr<const Response> Find(size_t from, size_t to); // null when not cached
+        void Insert(size_t from, size_t to, Response response);
+        Metrics GetMetrics() const;
+        size_t GetMemoryUsage() const;
+    private:
+        static constexpr size_t shard_count = 16;
+        struct Entry {
+            uint64_t key;
+            std::shared_ptr<const Response> response;
+            size_t response_bytes;
+        };
+        using Entries = std::list<Entry>;
+        struct Shard {
+            mutable std::mutex mutex;
+            Entries entries; // most recently used first
+            std::unordered_map<uint64_t, Entries::iterator> entry_by_key;
+            size_t response_bytes{0};
+        };
+        size_t shard_capacity_;
+        std::array<Shard, shard_count> shards_;
+        std::atomic<uint64_t> hits_{0}, misses_{0};
+        static uint64_t MakeKey(size_t from, size_t to);
+        Shard& GetShard(uint64_t key);
+    };
+}
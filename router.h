@@ -1,11 +1,15 @@
 #pragma once
 
+#include "delta_stepping.h"
 #include "graph.h"
+#include "memory_usage.h"
 
 #include <algorithm>
 #include <cassert>
 #include <cstdint>
 #include <iterator>
+#include <limits>
+#include <mutex>
 #include <optional>
 #include <unordered_map>
 #include <unordered_set>
@@ -21,7 +25,13 @@ namespace Graph {
     using Graph = DirectedWeightedGraph<Weight>;
 
   public:
-      Router(const Graph& graph, const std::vector<VertexId>& vertexes_to_compute);
+    // how the routes from each computed vertex are found: one Dijkstra per vertex,
+    // or a delta-stepping search that spreads every single-source search over all cores
+    enum class Algorithm {
+      Dijkstra,
+      DeltaStepping
+    };
+      Router(const Graph& graph, const std::vector<VertexId>& vertexes_to_compute, Algorithm algorithm = Algorithm::Dijkstra);
 
     using RouteId = uint64_t;
 
@@ -35,45 +45,65 @@ namespace Graph {
     EdgeId GetRouteEdge(RouteId route_id, size_t edge_idx) const;
     void ReleaseRoute(RouteId route_id);
 
+    // raw access to the computed table: the route weight and the last edge of the route
+    std::optional<Weight> GetRouteWeight(VertexId from, VertexId to) const;
+    std::optional<EdgeId> GetRouteLastEdge(VertexId from, VertexId to) const;
+
+    size_t GetMemoryUsage() const;
+    // route_count: pairs of a computed vertex and a vertex it reaches (or vertexes_to_compute * vertex_count)
+    static size_t EstimateMemoryUsage(size_t vertex_count, size_t edge_count, size_t route_count);
+
   private:
     const Graph& graph_;
 
+    // an entry exists only for reached vertices; the last edge of an empty route is no_edge
+    static constexpr EdgeId no_edge = std::numeric_limits<EdgeId>::max();
     struct RouteInternalData {
       Weight weight;
-      std::optional<EdgeId> prev_edge;
+      EdgeId prev_edge;
     };
-    using RoutesInternalDataMap = std::unordered_map<VertexId, std::unordered_map<VertexId, std::optional<RouteInternalData>>>;
+    using RoutesInternalDataMap = std::unordered_map<VertexId, std::unordered_map<VertexId, RouteInternalData>>;
 
     using ExpandedRoute = std::vector<EdgeId>;
+    mutable std::mutex expanded_routes_mutex_; // BuildRoute may be called from several query threads
     mutable RouteId next_route_id_ = 0;
     mutable std::unordered_map<RouteId, ExpandedRoute> expanded_routes_cache_;
 
       void InitializeRoutesInternalDataMap(const Graph& graph) {
           const size_t vertex_count = graph.GetVertexCount();
           for (VertexId vertex = 0; vertex < vertex_count; ++vertex) {
-              routes_internal_data_map_[vertex][vertex] = RouteInternalData{0, std::nullopt};
+              auto& routes_from = routes_internal_data_map_[vertex];
+              routes_from[vertex] = RouteInternalData{0, no_edge};
               for (const EdgeId edge_id : graph.GetIncidentEdges(vertex)) {
                   const auto& edge = graph.GetEdge(edge_id);
                   assert(edge.weight >= 0);
-                  if (routes_internal_data_map_[vertex].count(edge.to) == 0 ||
-                  !routes_internal_data_map_[vertex][edge.to] || routes_internal_data_map_[vertex][edge.to]->weight > edge.weight) {
-                      routes_internal_data_map_[vertex][edge.to] = RouteInternalData{edge.weight, edge_id};
+                  if (auto [it, inserted] = routes_from.try_emplace(edge.to, RouteInternalData{edge.weight, edge_id});
+                          !inserted && it->second.weight > edge.weight) {
+                      it->second = RouteInternalData{edge.weight, edge_id};
                   }
               }
           }
       }
 
+      // integer weights tie exactly, ties go to the route with the shorter last edge (a settled route stays as is)
+      bool IsBetterRoute(const RouteInternalData& candidate, const RouteInternalData& current, bool is_settled) const {
+          if (candidate.weight != current.weight) return candidate.weight < current.weight;
+          return !is_settled && candidate.prev_edge != no_edge && current.prev_edge != no_edge &&
+                 graph_.GetEdge(candidate.prev_edge).weight < graph_.GetEdge(current.prev_edge).weight;
+      }
+
       void RelaxRouteMap(VertexId vertex_from, VertexId vertex_to,
-                      const RouteInternalData& route_from, const RouteInternalData& route_to) {
-          auto& route_relaxing = routes_internal_data_map_[vertex_from][vertex_to];
-          const Weight candidate_weight = route_from.weight + route_to.weight;
-          if (!route_relaxing || candidate_weight < route_relaxing->weight) {
-              route_relaxing = {
-                      candidate_weight,
-                      route_to.prev_edge
-                      ? route_to.prev_edge
-                      : route_from.prev_edge
-              };
+                      const RouteInternalData& route_from, const RouteInternalData& route_to, bool is_settled) {
+          const Weight candidate_weight = AddWeights(route_from.weight, route_to.weight);
+          const RouteInternalData candidate{
+                  candidate_weight,
+                  route_to.prev_edge != no_edge
+                  ? route_to.prev_edge
+                  : route_from.prev_edge
+          };
+          auto [it, inserted] = routes_internal_data_map_[vertex_from].try_emplace(vertex_to, candidate);
+          if (!inserted && IsBetterRoute(candidate, it->second, is_settled)) {
+              it->second = candidate;
           }
       }
 
@@ -84,7 +114,7 @@ namespace Graph {
       };
     void DijkstraAlgorithm(size_t vertex_count, VertexId vertex_from) {
         std::set<WeightVertexId> unused;
-        unused.insert({0., vertex_from});
+        unused.insert({Weight(0), vertex_from});
         std::unordered_set<VertexId> used;
         while (!unused.empty()) {
             WeightVertexId curr_wvi = *(unused.begin());
@@ -92,10 +122,12 @@ namespace Graph {
             used.insert(curr_wvi.vertex_id);
             for (const EdgeId edge_id : graph_.GetIncidentEdges(curr_wvi.vertex_id)) {
                 auto edge = graph_.GetEdge(edge_id);
-                if (routes_internal_data_map_[curr_wvi.vertex_id].count(edge.to) != 0;
-                        const auto& second_route = routes_internal_data_map_[curr_wvi.vertex_id][edge.to]) {
-                    RelaxRouteMap(vertex_from, edge.to, routes_internal_data_map_[vertex_from][curr_wvi.vertex_id].value(), second_route.value());
-                    unused.insert({routes_internal_data_map_[vertex_from][edge.to]->weight, edge.to});
+                const auto& routes_from_current = routes_internal_data_map_[curr_wvi.vertex_id];
+                if (auto second_route = routes_from_current.find(edge.to); second_route != routes_from_current.end()) {
+                    // copied: relaxing may rehash the row that holds the first route
+                    const RouteInternalData first_route = routes_internal_data_map_[vertex_from].at(curr_wvi.vertex_id);
+                    RelaxRouteMap(vertex_from, edge.to, first_route, second_route->second, used.count(edge.to) != 0);
+                    unused.insert({routes_internal_data_map_[vertex_from].at(edge.to).weight, edge.to});
                 }
             }
             while (!unused.empty() && used.count(unused.begin()->vertex_id) != 0) unused.erase(unused.begin());
@@ -106,44 +138,90 @@ namespace Graph {
   };
 
     template <typename Weight>
-    Router<Weight>::Router(const Graph& graph, const std::vector<VertexId>& vertexes_to_compute)
+    Router<Weight>::Router(const Graph& graph, const std::vector<VertexId>& vertexes_to_compute, Algorithm algorithm)
             : graph_(graph)
     {
-        InitializeRoutesInternalDataMap(graph);
         const size_t vertex_count = graph.GetVertexCount();
+        if (algorithm == Algorithm::DeltaStepping) {
+            // only the rows of the computed vertices are kept
+            DeltaStepping<Weight> search(graph, DeltaStepping<Weight>::ChooseDelta(graph));
+            for (auto vertex : vertexes_to_compute) {
+                search.Run(vertex);
+                auto& routes_from = routes_internal_data_map_[vertex];
+                for (VertexId to = 0; to < vertex_count; ++to) {
+                    if (search.IsReached(to)) routes_from[to] = RouteInternalData{search.GetWeight(to), search.GetPrevEdge(to).value_or(no_edge)};
+                }
+            }
+            return;
+        }
+        InitializeRoutesInternalDataMap(graph);
         for (auto vertex : vertexes_to_compute) DijkstraAlgorithm(vertex_count, vertex);
     }
 
 
   template <typename Weight>
   std::optional<typename Router<Weight>::RouteInfo> Router<Weight>::BuildRoute(VertexId from, VertexId to) const {
-      if (routes_internal_data_map_.at(from).count(to) == 0) return std::nullopt;
-    const auto& route_internal_data = routes_internal_data_map_.at(from).at(to);
-    if (!route_internal_data) {
+    const auto& routes_from = routes_internal_data_map_.at(from);
+    const auto route_internal_data = routes_from.find(to);
+    if (route_internal_data == routes_from.end()) {
       return std::nullopt;
     }
-    const Weight weight = route_internal_data->weight;
+    const Weight weight = route_internal_data->second.weight;
     std::vector<EdgeId> edges;
-    for (std::optional<EdgeId> edge_id = route_internal_data->prev_edge;
-         edge_id;
-         edge_id = routes_internal_data_map_.at(from).at(graph_.GetEdge(*edge_id).from)->prev_edge) {
-      edges.push_back(*edge_id);
+    for (EdgeId edge_id = route_internal_data->second.prev_edge;
+         edge_id != no_edge;
+         edge_id = routes_from.at(graph_.GetEdge(edge_id).from).prev_edge) {
+      edges.push_back(edge_id);
     }
     std::reverse(std::begin(edges), std::end(edges));
 
-    const RouteId route_id = next_route_id_++;
     const size_t route_edge_count = edges.size();
+    std::lock_guard<std::mutex> guard(expanded_routes_mutex_);
+    const RouteId route_id = next_route_id_++;
     expanded_routes_cache_[route_id] = std::move(edges);
     return RouteInfo{route_id, weight, route_edge_count};
   }
 
   template <typename Weight>
   EdgeId Router<Weight>::GetRouteEdge(RouteId route_id, size_t edge_idx) const {
+    std::lock_guard<std::mutex> guard(expanded_routes_mutex_);
     return expanded_routes_cache_.at(route_id)[edge_idx];
   }
 
   template <typename Weight>
   void Router<Weight>::ReleaseRoute(RouteId route_id) {
+    std::lock_guard<std::mutex> guard(expanded_routes_mutex_);
     expanded_routes_cache_.erase(route_id);
   }
+
+  template <typename Weight>
+  std::optional<Weight> Router<Weight>::GetRouteWeight(VertexId from, VertexId to) const {
+    const auto& routes_from = routes_internal_data_map_.at(from);
+    if (auto it = routes_from.find(to); it != routes_from.end()) return it->second.weight;
+    return std::nullopt;
+  }
+
+  template <typename Weight>
+  std::optional<EdgeId> Router<Weight>::GetRouteLastEdge(VertexId from, VertexId to) const {
+    const auto& routes_from = routes_internal_data_map_.at(from);
+    if (auto it = routes_from.find(to); it != routes_from.end() && it->second.prev_edge != no_edge) {
+      return it->second.prev_edge;
+    }
+    return std::nullopt;
+  }
+
+  template <typename Weight>
+  size_t Router<Weight>::GetMemoryUsage() const {
+    return Memory::HeapBytes(routes_internal_data_map_);
+  }
+
+  template <typename Weight>
+  size_t Router<Weight>::EstimateMemoryUsage(size_t vertex_count, size_t edge_count, size_t route_count) {
+    // every vertex keeps a row with its direct neighbours, every computed vertex an entry per reached vertex
+    using Row = typename RoutesInternalDataMap::mapped_type;
+    constexpr size_t row_bytes = sizeof(std::pair<const VertexId, Row>) + Memory::hash_node_overhead + sizeof(void*);
+    constexpr size_t entry_bytes = sizeof(std::pair<const VertexId, RouteInternalData>) +
+            Memory::hash_node_overhead + sizeof(void*);
+    return vertex_count * row_bytes + (vertex_count + edge_count + route_count) * entry_bytes;
+  }
 }
@@ -0,0 +1,207 @@
+#include "server.h"
+#include "requests.h"
+#include "parallel.h"
+#include "json_schema.h"
+
+#include <fstream>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace Transport::Server {
+    namespace {
+        using Json::Required;
+        const auto reload_request_schema = Json::MakeSchema<ReloadRequest>(
+                Required("id", &ReloadRequest::id), Required("path", &ReloadRequest::path));
+        // the id of a request that failed to decode, for its error response
+        std::optional<size_t> FindRequestId(const Json::Node& request) {
+            if (!request.HoldsMap()) return std::nullopt;
+            const auto it = request.AsMap().find("id");
+            if (it == request.AsMap().end() || !it->second.HoldsInt() || it->second.AsInt() < 0) return std::nullopt;
+            return it->second.AsInt();
+        }
+        DatabaseSnapshots::Snapshot BuildSnapshot(const Json::Document& base) {
+            auto tdb = std::make_shared<TransportDatabase>();
+            Requests::ProcessRequests(Requests::ParseBaseRequests(base), *tdb);
+            return tdb;
+        }
+    }
+    WorkerLane::WorkerLane(size_t thread_count) {
+        for (size_t i = 0; i < std::max<size_t>(thread_count, 1); ++i) threads_.emplace_back([this] { Work(); });
+    }
+    WorkerLane::~WorkerLane() {
+        {
+            std::lock_guard<std::mutex> guard(mutex_);
+            is_stopped_ = true;
+        }
+        has_tasks_.notify_all();
+        for (auto& thread : threads_) thread.join();
+    }
+    void WorkerLane::Push(std::function<void()> task) {
+        {
+            std::lock_guard<std::mutex> guard(mutex_);
+            tasks_.push(std::move(task));
+        }
+        has_tasks_.notify_one();
+    }
+    void WorkerLane::Work() {
+        while (true) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                has_tasks_.wait(lock, [this] { return is_stopped_ || !tasks_.empty(); });
+                if (tasks_.empty()) return;
+                task = std::move(tasks_.front());
+                tasks_.pop();
+            }
+            task();
+        }
+    }
+
+    DatabaseSnapshots::Snapshot LoadSnapshot(const std::string& path) {
+        return BuildSnapshot(Json::LoadFile(path));
+    }
+    DatabaseSnapshots::Snapshot LoadSnapshot(std::istream& input) {
+        return BuildSnapshot(Json::Load(input));
+    }
+
+    size_t WarmUp(const TransportDatabase& tdb, std::istream& query_log) {
+        std::vector<Requests::GetRouteRequest> requests;
+        for (std::string line; std::getline(query_log, line); ) {
+            try {
+                Requests::StatRequest request = Requests::ParseStatRequest(Json::Load(std::string_view(line)).GetRoot());
+                if (auto* route_request = std::get_if<Requests::GetRouteRequest>(&request)) requests.push_back(std::move(*route_request));
+            } catch (const std::exception&) {}
+        }
+        ParallelFor(requests.size(), [&](size_t i) {
+            try {
+                Requests::Process(requests[i], tdb);
+            } catch (const std::exception&) {}
+        });
+        return requests.size();
+    }
+
+    QueryServer::QueryServer(DatabaseSnapshots& snapshots, ServerSettings settings)
+            : snapshots_(snapshots), warmup_path_(std::move(settings.warmup_path)), exact_numbers_(settings.exact_numbers),
+              light_lane_(settings.light_threads), heavy_lane_(settings.heavy_threads), builder_lane_(1) {
+        WarmUp(*snapshots_.Acquire());
+    }
+    void QueryServer::WarmUp(const TransportDatabase& tdb) const {
+        if (warmup_path_.empty()) return;
+        std::ifstream query_log(warmup_path_);
+        if (!query_log) throw std::runtime_error("can't open " + warmup_path_);
+        Server::WarmUp(tdb, query_log);
+    }
+    Json::Node QueryServer::Error(const std::string& message, std::optional<size_t> request_id) {
+        std::map<std::string, Json::Node> response {{"error_message", message}};
+        if (request_id) response["request_id"] = static_cast<int>(*request_id);
+        return response;
+    }
+    Json::Node QueryServer::Reload(const ReloadRequest& request) {
+        // a missing file throws "can't open", which the dispatch answers with the request id
+        DatabaseSnapshots::Snapshot snapshot = LoadSnapshot(request.path);
+        WarmUp(*snapshot);
+        uint64_t version = snapshots_.Publish(std::move(snapshot));
+        // queries that still run on the previous version keep it alive, the last of them schedules its reclaim
+        snapshots_.ReclaimRetired();
+        return std::map<std::string, Json::Node> {{"request_id", static_cast<int>(request.id)}, {"version", static_cast<int>(version)}};
+    }
+    void QueryServer::ScheduleReclaim() {
+        if (snapshots_.GetRetiredCount() == 0 || is_reclaim_scheduled_.exchange(true)) return;
+        builder_lane_.Push([this] {
+            is_reclaim_scheduled_ = false;
+            snapshots_.ReclaimRetired();
+        });
+    }
+    void QueryServer::Serve(std::istream& input, std::ostream& output) {
+        std::mutex mutex;
+        std::condition_variable is_drained;
+        size_t in_flight = 0;
+        auto write = [&output, &mutex, this](const Json::Node& response) {
+            std::lock_guard<std::mutex> guard(mutex);
+            if (exact_numbers_) {
+                Json::PrintExact(response, output);
+            } else {
+                Json::PrintCompact(response, output);
+            }
+            output << '\n';
+            output.flush();
+        };
+        auto dispatch = [&](WorkerLane& lane, size_t request_id, std::function<Json::Node()> job) {
+            {
+                std::lock_guard<std::mutex> guard(mutex);
+                ++in_flight;
+            }
+            lane.Push([this, job = std::move(job), request_id, &write, &mutex, &in_flight, &is_drained] {
+                Json::Node response;
+                try {
+                    response = job();
+                } catch (const std::exception& error) {
+                    response = Error(error.what(), request_id);
+                }
+                ScheduleReclaim();
+                write(response);
+                std::lock_guard<std::mutex> guard(mutex);
+                if (--in_flight == 0) is_drained.notify_all();
+            });
+        };
+        for (std::string line; std::getline(input, line); ) {
+            if (line.find_first_not_of(" \t\r") == std::string::npos) continue;
+            std::optional<Requests::StatRequest> request;
+            std::optional<ReloadRequest> reload_request;
+            std::optional<size_t> request_id;
+            try {
+                Json::Document document = Json::Load(std::string_view(line));
+                request_id = FindRequestId(document.GetRoot());
+                if (Requests::ParseType(document.GetRoot()) == "Reload") {
+                    reload_request = reload_request_schema.Decode(document.GetRoot());
+                } else {
+                    request = Requests::ParseStatRequest(document.GetRoot());
+                }
+            } catch (const std::exception& error) {
+                write(Error(error.what(), request_id));
+                continue;
+            }
+            if (reload_request) {
+                dispatch(builder_lane_, reload_request->id, [this, reload_request = std::move(*reload_request)] {
+                    return Reload(reload_request);
+                });
+            } else {
+                WorkerLane& lane = Requests::IsRouteSearch(*request) ? heavy_lane_ : light_lane_;
+                dispatch(lane, Requests::GetRequestId(*request), [this, request = std::move(*request)] {
+                    DatabaseSnapshots::Snapshot snapshot = snapshots_.Acquire();
+                    return Requests::Process(request, *snapshot);
+                });
+            }
+        }
+        std::unique_lock<std::mutex> lock(mutex);
+        is_drained.wait(lock, [&in_flight] { return in_flight == 0; });
+    }
+    void QueryServer::ServeUnixSocket(const std::string& path) {
+        int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (listen_fd < 0) throw std::runtime_error("can't create unix socket");
+        sockaddr_un address{};
+        address.sun_family = AF_UNIX;
+        if (path.size() >= sizeof(address.sun_path)) throw std::invalid_argument("unix socket path is too long");
+        path.copy(address.sun_path, path.size());
+        unlink(path.c_str());
+        if (bind(listen_fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0 || listen(listen_fd, 64) != 0) {
+            close(listen_fd);
+            throw std::runtime_error("can't listen on unix socket " + path);
+        }
+        for (int fd; (fd = accept(listen_fd, nullptr, nullptr)) >= 0; ) {
+            std::thread([this, fd] {
+                {
+                    FdStreamBuf buffer(fd);
+                    std::istream input(&buffer);
+                    std::ostream output(&buffer);
+                    Serve(input, output);
+                }
+                close(fd);
+            }).detach();
+        }
+        close(listen_fd);
+        throw std::runtime_error("can't accept connection on unix socket " + path);
+    }
+}
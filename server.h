@@ -0,0 +1,117 @@
+#pragma once
+
+#ifndef CPPCOURSERA_SERVER_H
+#define CPPCOURSERA_SERVER_H
+
+#endif //CPPCOURSERA_SERVER_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <optional>
+#include <queue>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+
+#include "database_snapshots.h"
+#include "json.h"
+
+namespace Transport::Server {
+    class WorkerLane {
+    public:
+        explicit WorkerLane(size_t thread_count);
+        WorkerLane(const WorkerLane&) = delete;
+        WorkerLane& operator = (const WorkerLane&) = delete;
+        ~WorkerLane();
+        void Push(std::function<void()> task);
+    private:
+        std::mutex mutex_;
+        std::condition_variable has_tasks_;
+        std::queue<std::function<void()>> tasks_;
+        bool is_stopped_{false};
+        std::vector<std::thread> threads_;
+        void Work();
+    };
+    // Buffered reads and writes of a socket or pipe descriptor, for iostreams over a connection
+    class FdStreamBuf : public std::streambuf {
+    public:
+        explicit FdStreamBuf(int fd) : fd_(fd) {
+            setg(input_buffer_, input_buffer_, input_buffer_);
+            setp(output_buffer_, output_buffer_ + sizeof(output_buffer_));
+        }
+        ~FdStreamBuf() override { sync(); }
+    protected:
+        int_type underflow() override {
+            ssize_t count = read(fd_, input_buffer_, sizeof(input_buffer_));
+            if (count <= 0) return traits_type::eof();
+            setg(input_buffer_, input_buffer_, input_buffer_ + count);
+            return traits_type::to_int_type(*gptr());
+        }
+        int_type overflow(int_type ch) override {
+            if (sync() != 0) return traits_type::eof();
+            if (!traits_type::eq_int_type(ch, traits_type::eof())) {
+                *pptr() = traits_type::to_char_type(ch);
+                pbump(1);
+            }
+            return traits_type::not_eof(ch);
+        }
+        int sync() override {
+            for (const char* begin = pbase(); begin != pptr(); ) {
+                ssize_t count = write(fd_, begin, pptr() - begin);
+                if (count <= 0) return -1;
+                begin += count;
+            }
+            setp(output_buffer_, output_buffer_ + sizeof(output_buffer_));
+            return 0;
+        }
+    private:
+        int fd_;
+        char input_buffer_[1 << 16];
+        char output_buffer_[1 << 16];
+    };
+    struct ServerSettings {
+        size_t light_threads{1};
+        size_t heavy_threads{std::max(1u, std::thread::hardware_concurrency())};
+        std::string warmup_path; // recorded query log replayed into the route cache of every loaded version
+        bool exact_numbers{false}; // responses keep every digit of doubles, for a sharding coordinator
+    };
+    // {"type": "Reload", "id": ..., "path": ...}
+    struct ReloadRequest {
+        size_t id{0};
+        std::string path;
+    };
+    // a base read from a file is mapped and parsed in place; the stream overload is for stdin
+    DatabaseSnapshots::Snapshot LoadSnapshot(const std::string& path);
+    DatabaseSnapshots::Snapshot LoadSnapshot(std::istream& input);
+    // Answers the Route requests of a newline-delimited query log, so that their responses get cached.
+    // Returns the number of replayed requests; lines that are not Route requests are skipped.
+    size_t WarmUp(const TransportDatabase& tdb, std::istream& query_log);
+    // Answers newline-delimited json stat requests against the current database snapshot.
+    // Cheap lookups (Bus, Stop, ...) and Route queries go to separate worker lanes,
+    // so responses are written as soon as they are ready and may come out of order.
+    // A Reload request builds a new database in the builder lane, publishes it and answers with its version.
+    // The previous version is freed in the builder lane too, once the queries still running on it finish.
+    class QueryServer {
+    public:
+        QueryServer(DatabaseSnapshots& snapshots, ServerSettings settings);
+        void Serve(std::istream& input, std::ostream& output);
+        void ServeUnixSocket(const std::string& path);
+    private:
+        DatabaseSnapshots& snapshots_;
+        std::string warmup_path_;
+        bool exact_numbers_;
+        WorkerLane light_lane_, heavy_lane_, builder_lane_;
+        std::atomic<bool> is_reclaim_scheduled_{false};
+        void WarmUp(const TransportDatabase& tdb) const;
+        // queues a ReclaimRetired in the builder lane if retired versions wait and none is queued
+        void ScheduleReclaim();
+        // request_id is left out when the request is too broken to read its id
+        static Json::Node Error(const std::string& message, std::optional<size_t> request_id = std::nullopt);
+        Json::Node Reload(const ReloadRequest& request);
+    };
+}
@@ -0,0 +1,302 @@
+#include "sharding.h"
+#include "json_schema.h"
+#include "point.h"
+#include "requests.h"
+
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <queue>
+#include <set>
+#include <stdexcept>
+#include <tuple>
+#include <variant>
+
+#include <spawn.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char** environ;
+
+namespace Transport::Sharding {
+    namespace {
+        using NodeMap = std::map<std::string, Json::Node>;
+    }
+
+    Regions SplitBase(const Json::Document& base, size_t region_count) {
+        if (region_count == 0) throw std::invalid_argument("at least one region is expected");
+        const NodeMap& root = base.GetRoot().AsMap();
+        // decoded requests, each with its json that goes to the shards
+        std::vector<std::pair<const NodeMap*, StopHandler>> stops;
+        std::vector<std::pair<const NodeMap*, BusHandler>> buses;
+        const auto& base_requests = root.at("base_requests").AsArray();
+        for (size_t i = 0; i < base_requests.size(); ++i) {
+            Json::DecodeField("base_requests[" + std::to_string(i) + "]", [&] {
+                const std::string type = Requests::ParseType(base_requests[i]);
+                if (type == "Stop") {
+                    stops.emplace_back(&base_requests[i].AsMap(), Requests::ParseStop(base_requests[i]));
+                } else if (type == "Bus") {
+                    buses.emplace_back(&base_requests[i].AsMap(), Requests::ParseBus(base_requests[i]));
+                } else {
+                    throw std::invalid_argument("unknown type of request");
+                }
+            });
+        }
+        std::vector<std::pair<uint64_t, const Stop*>> keyed_stops;
+        for (const auto& [_, stop] : stops) keyed_stops.emplace_back(Points::GetHilbertIndex(stop->location), stop.get());
+        std::sort(keyed_stops.begin(), keyed_stops.end(), [](const auto& lhs, const auto& rhs) {
+            return std::tie(lhs.first, lhs.second->name) < std::tie(rhs.first, rhs.second->name);
+        });
+        std::unordered_map<StopName, size_t> region_by_stop;
+        for (size_t i = 0; i < keyed_stops.size(); ++i) {
+            region_by_stop[keyed_stops[i].second->name] = i * region_count / keyed_stops.size();
+        }
+
+        Regions result;
+        std::vector<std::set<StopName>> shard_stops(region_count);
+        for (const auto& [name, region] : region_by_stop) shard_stops[region].insert(name);
+        std::vector<std::vector<Json::Node>> shard_requests(region_count);
+        for (const auto& [request, bus] : buses) {
+            std::vector<size_t> stop_counts(region_count);
+            for (const auto& stop_name : bus->route.GetStopNames()) ++stop_counts[region_by_stop.at(stop_name)];
+            const size_t region = std::max_element(stop_counts.begin(), stop_counts.end()) - stop_counts.begin();
+            result.shard_by_bus[bus->number] = region;
+            for (const auto& stop_name : bus->route.GetStopNames()) shard_stops[region].insert(stop_name);
+            shard_requests[region].emplace_back(*request);
+        }
+        for (size_t region = 0; region < region_count; ++region) {
+            for (const auto& name : shard_stops[region]) result.shards_by_stop[name].push_back(region);
+        }
+        // a stop goes to every shard that has it, with the road distances to the other stops of the shard
+        for (const auto& [request, stop] : stops) {
+            for (size_t region : result.shards_by_stop.at(stop->name)) {
+                NodeMap shard_stop = *request;
+                NodeMap road_distances;
+                for (const auto& [name, distance] : stop->distance_to_stops) {
+                    if (shard_stops[region].count(name) != 0) road_distances.emplace(name, distance);
+                }
+                shard_stop["road_distances"] = std::move(road_distances);
+                shard_requests[region].emplace_back(std::move(shard_stop));
+            }
+        }
+        for (auto& requests : shard_requests) {
+            NodeMap shard_root = root;
+            shard_root.erase("stat_requests");
+            shard_root["base_requests"] = std::move(requests);
+            result.bases.emplace_back(Json::Node(std::move(shard_root)));
+        }
+        return result;
+    }
+
+    ShardProcess::ShardProcess(const Json::Document& base) {
+        int fds[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) != 0) throw std::runtime_error("can't create a socket pair for a shard");
+        posix_spawn_file_actions_t actions;
+        posix_spawn_file_actions_init(&actions);
+        posix_spawn_file_actions_adddup2(&actions, fds[1], STDIN_FILENO);
+        posix_spawn_file_actions_adddup2(&actions, fds[1], STDOUT_FILENO);
+        posix_spawn_file_actions_addclose(&actions, fds[0]);
+        posix_spawn_file_actions_addclose(&actions, fds[1]);
+        char executable[] = "/proc/self/exe", serve[] = "--serve", light_threads[] = "--light-threads",
+             heavy_threads[] = "--heavy-threads", one[] = "1", exact_numbers[] = "--exact-numbers";
+        // the sockets of other shards are close-on-exec, a child holding one would keep that shard from exiting
+        char* argv[] = {executable, serve, light_threads, one, heavy_threads, one, exact_numbers, nullptr};
+        const int error = posix_spawn(&pid_, executable, &actions, nullptr, argv, environ);
+        posix_spawn_file_actions_destroy(&actions);
+        close(fds[1]);
+        if (error != 0) {
+            close(fds[0]);
+            throw std::runtime_error("can't start a shard process");
+        }
+        fd_ = fds[0];
+        buffer_ = std::make_unique<Server::FdStreamBuf>(fd_);
+        stream_ = std::make_unique<std::iostream>(buffer_.get());
+        // the shard reads its base document first, then serves newline-delimited requests
+        Json::PrintExact(base.GetRoot(), *stream_);
+        *stream_ << '\n';
+        stream_->flush();
+    }
+    ShardProcess::~ShardProcess() {
+        stream_.reset();
+        buffer_.reset();
+        if (fd_ >= 0) close(fd_);
+        if (pid_ > 0) waitpid(pid_, nullptr, 0);
+    }
+    Json::Node ShardProcess::Ask(const Json::Node& request) {
+        Json::PrintCompact(request, *stream_);
+        *stream_ << '\n';
+        stream_->flush();
+        std::string line;
+        if (!std::getline(*stream_, line)) throw std::runtime_error("shard process closed the connection");
+        return Json::Load(std::string_view(line)).GetRoot();
+    }
+
+    Coordinator::Coordinator(const Regions& regions, std::vector<ShardConnection> shards)
+            : shards_(std::move(shards)), shards_by_stop_(regions.shards_by_stop), shard_by_bus_(regions.shard_by_bus),
+              boundary_by_shard_(shards_.size()) {
+        for (const auto& [name, stop_shards] : shards_by_stop_) {
+            if (stop_shards.size() > 1) boundary_stops_.push_back(name);
+        }
+        std::sort(boundary_stops_.begin(), boundary_stops_.end());
+        for (size_t i = 0; i < boundary_stops_.size(); ++i) {
+            for (size_t shard : shards_by_stop_.at(boundary_stops_[i])) boundary_by_shard_[shard].push_back(i);
+        }
+        overlay_edges_.resize(boundary_stops_.size());
+        for (size_t shard = 0; shard < shards_.size(); ++shard) {
+            const std::vector<size_t>& boundary = boundary_by_shard_[shard];
+            std::vector<StopName> names;
+            for (size_t i : boundary) names.push_back(boundary_stops_[i]);
+            const auto times = AskMatrix(shard, names, names);
+            for (size_t i = 0; i < boundary.size(); ++i) {
+                for (size_t j = 0; j < boundary.size(); ++j) {
+                    if (i != j && times[i][j]) overlay_edges_[boundary[i]].push_back({boundary[j], *times[i][j], shard});
+                }
+            }
+        }
+    }
+    size_t Coordinator::GetBoundaryStopCount() const {
+        return boundary_stops_.size();
+    }
+    Json::Node Coordinator::Ask(size_t shard, NodeMap request) const {
+        request["id"] = 0;
+        return shards_[shard](Json::Node(std::move(request)));
+    }
+    std::vector<std::vector<std::optional<double>>> Coordinator::AskMatrix(size_t shard, const std::vector<StopName>& from,
+                                                                           const std::vector<StopName>& to) const {
+        std::vector<std::vector<std::optional<double>>> result(from.size(), std::vector<std::optional<double>>(to.size()));
+        if (from.empty() || to.empty()) return result;
+        std::vector<Json::Node> from_nodes(from.begin(), from.end()), to_nodes(to.begin(), to.end());
+        Json::Node response = Ask(shard, {{"type", std::string("Matrix")}, {"from", std::move(from_nodes)}, {"to", std::move(to_nodes)}});
+        const auto& rows = response.AsMap().at("total_times").AsArray();
+        for (size_t i = 0; i < from.size(); ++i) {
+            for (size_t j = 0; j < to.size(); ++j) {
+                if (!rows[i].AsArray()[j].IsNull()) result[i][j] = Json::Decode<double>(rows[i].AsArray()[j]);
+            }
+        }
+        return result;
+    }
+    Json::Node Coordinator::GetRoute(const StopName& from, const StopName& to, size_t request_id) const {
+        auto from_it = shards_by_stop_.find(from), to_it = shards_by_stop_.find(to);
+        if (from_it == shards_by_stop_.end() || to_it == shards_by_stop_.end()) return NodeNotFound(request_id);
+        auto route_in_shard = [&](size_t shard, const StopName& leg_from, const StopName& leg_to) {
+            return Ask(shard, {{"type", std::string("Route")}, {"from", leg_from}, {"to", leg_to}});
+        };
+        if (from == to) {
+            NodeMap result = route_in_shard(from_it->second.front(), from, to).AsMap();
+            result["request_id"] = static_cast<int>(request_id);
+            return result;
+        }
+        // overlay vertices are the boundary stops, then the origin and the destination
+        const size_t source = boundary_stops_.size(), target = source + 1;
+        std::vector<OverlayEdge> source_edges;
+        for (size_t shard : from_it->second) {
+            std::vector<StopName> names;
+            for (size_t i : boundary_by_shard_[shard]) names.push_back(boundary_stops_[i]);
+            const bool has_target = std::binary_search(to_it->second.begin(), to_it->second.end(), shard);
+            if (has_target) names.push_back(to);
+            const auto times = AskMatrix(shard, {from}, names);
+            for (size_t j = 0; j < names.size(); ++j) {
+                if (!times[0][j]) continue;
+                const size_t vertex = has_target && j + 1 == names.size() ? target : boundary_by_shard_[shard][j];
+                source_edges.push_back({vertex, *times[0][j], shard});
+            }
+        }
+        std::vector<std::vector<OverlayEdge>> target_edges(boundary_stops_.size());
+        for (size_t shard : to_it->second) {
+            std::vector<StopName> names;
+            for (size_t i : boundary_by_shard_[shard]) names.push_back(boundary_stops_[i]);
+            const auto times = AskMatrix(shard, names, {to});
+            for (size_t i = 0; i < names.size(); ++i) {
+                if (times[i][0]) target_edges[boundary_by_shard_[shard][i]].push_back({target, *times[i][0], shard});
+            }
+        }
+
+        std::vector<double> times(target + 1, std::numeric_limits<double>::infinity());
+        std::vector<std::pair<size_t, size_t>> prev(target + 1); // vertex and shard of the leg into a vertex
+        using QueueItem = std::pair<double, size_t>;
+        std::priority_queue<QueueItem, std::vector<QueueItem>, std::greater<QueueItem>> queue;
+        times[source] = 0;
+        queue.emplace(0, source);
+        while (!queue.empty()) {
+            // not a structured binding, the relax lambda captures them
+            const double time = queue.top().first;
+            const size_t vertex = queue.top().second;
+            queue.pop();
+            if (times[vertex] < time) continue;
+            if (vertex == target) break;
+            auto relax = [&](const std::vector<OverlayEdge>& edges) {
+                for (const OverlayEdge& edge : edges) {
+                    if (time + edge.time < times[edge.to]) {
+                        times[edge.to] = time + edge.time;
+                        prev[edge.to] = {vertex, edge.shard};
+                        queue.emplace(times[edge.to], edge.to);
+                    }
+                }
+            };
+            if (vertex == source) {
+                relax(source_edges);
+            } else {
+                relax(overlay_edges_[vertex]);
+                relax(target_edges[vertex]);
+            }
+        }
+        if (times[target] == std::numeric_limits<double>::infinity()) return NodeNotFound(request_id);
+
+        auto stop_name = [&](size_t vertex) -> const StopName& {
+            return vertex == source ? from : vertex == target ? to : boundary_stops_[vertex];
+        };
+        std::vector<std::pair<size_t, size_t>> legs; // end vertex and shard
+        for (size_t vertex = target; vertex != source; vertex = prev[vertex].first) legs.emplace_back(vertex, prev[vertex].second);
+        std::reverse(legs.begin(), legs.end());
+        double total_time = 0;
+        std::vector<Json::Node> items;
+        size_t leg_begin = source;
+        for (const auto& [leg_end, shard] : legs) {
+            if (stop_name(leg_begin) != stop_name(leg_end)) {
+                Json::Node route = route_in_shard(shard, stop_name(leg_begin), stop_name(leg_end));
+                if (route.AsMap().count("total_time") == 0) return NodeNotFound(request_id);
+                total_time += Json::Decode<double>(route.AsMap().at("total_time"));
+                for (const auto& item : route.AsMap().at("items").AsArray()) items.push_back(item);
+            }
+            leg_begin = leg_end;
+        }
+        return NodeMap {{"request_id", static_cast<int>(request_id)}, {"total_time", total_time}, {"items", std::move(items)}};
+    }
+    Json::Node Coordinator::GetStop(const StopName& name, size_t request_id) const {
+        auto it = shards_by_stop_.find(name);
+        if (it == shards_by_stop_.end()) return NodeNotFound(request_id);
+        std::set<std::string> buses;
+        for (size_t shard : it->second) {
+            Json::Node stop = Ask(shard, {{"type", std::string("Stop")}, {"name", name}});
+            for (const auto& bus : stop.AsMap().at("buses").AsArray()) buses.insert(bus.AsString());
+        }
+        return NodeMap {{"request_id", static_cast<int>(request_id)}, {"buses", std::vector<Json::Node>(buses.begin(), buses.end())}};
+    }
+    Json::Node Coordinator::Process(const Json::Node& request) const {
+        const Requests::StatRequest parsed = Requests::ParseStatRequest(request);
+        if (const auto* route = std::get_if<Requests::GetRouteRequest>(&parsed)) {
+            return GetRoute(route->from, route->to, route->id);
+        } else if (const auto* stop = std::get_if<Requests::GetStopRequest>(&parsed)) {
+            return GetStop(stop->stop_name, stop->id);
+        } else if (const auto* bus = std::get_if<Requests::GetBusRequest>(&parsed)) {
+            auto it = shard_by_bus_.find(bus->bus_number);
+            if (it == shard_by_bus_.end()) return NodeNotFound(bus->id);
+            NodeMap result = Ask(it->second, {{"type", std::string("Bus")}, {"name", bus->bus_number}}).AsMap();
+            result["request_id"] = static_cast<int>(bus->id);
+            return result;
+        }
+        throw std::invalid_argument("unsupported type of request for a sharded database");
+    }
+
+    Json::Document ProcessStatRequests(const Json::Document& document, const Coordinator& coordinator) {
+        std::vector<Json::Node> request_results;
+        const auto& requests = document.GetRoot().AsMap().at("stat_requests").AsArray();
+        for (size_t i = 0; i < requests.size(); ++i) {
+            Json::DecodeField("stat_requests[" + std::to_string(i) + "]", [&] {
+                request_results.push_back(coordinator.Process(requests[i]));
+            });
+        }
+        return Json::Document(Json::Node(request_results));
+    }
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#ifndef CPPCOURSERA_SHARDING_H
+#define CPPCOURSERA_SHARDING_H
+
+#endif //CPPCOURSERA_SHARDING_H
+
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <sys/types.h>
+
+#include "json.h"
+#include "server.h"
+#include "transport.h"
+
+namespace Transport::Sharding {
+    // Stops are split into regions of equal size along a Hilbert curve over their locations. A bus goes
+    // whole to the region of most of its stops, and the shard of a region has its own stops and the stops
+    // of its buses. A route changes buses only at stops, so a route between shards passes the stops
+    // that several shards share.
+    struct Regions {
+        std::vector<Json::Document> bases; // base documents of the shards, without stat requests
+        std::unordered_map<StopName, std::vector<size_t>> shards_by_stop; // in increasing order
+        std::unordered_map<BusNumber, size_t> shard_by_bus;
+    };
+    Regions SplitBase(const Json::Document& base, size_t region_count);
+
+    // sends a stat request to a shard and returns its response
+    using ShardConnection = std::function<Json::Node(const Json::Node& request)>;
+
+    // Runs a shard in a child process of this executable in --serve mode, connected by a unix socket pair.
+    // Requests are answered one at a time.
+    class ShardProcess {
+    public:
+        explicit ShardProcess(const Json::Document& base);
+        ShardProcess(const ShardProcess&) = delete;
+        ShardProcess& operator = (const ShardProcess&) = delete;
+        ~ShardProcess();
+        Json::Node Ask(const Json::Node& request);
+    private:
+        int fd_{-1};
+        pid_t pid_{-1};
+        std::unique_ptr<Server::FdStreamBuf> buffer_;
+        std::unique_ptr<std::iostream> stream_;
+    };
+
+    // Answers Route, Stop and Bus requests from the shards. Stops shared by several shards form an overlay
+    // graph whose edges are the route times between them inside a shard, asked once with Matrix requests.
+    // A Route request adds the times from the origin and to the destination in their shards, searches
+    // the overlay and joins the shard routes of its legs.
+    class Coordinator {
+    public:
+        Coordinator(const Regions& regions, std::vector<ShardConnection> shards);
+        Json::Node Process(const Json::Node& request) const;
+        size_t GetBoundaryStopCount() const;
+    private:
+        struct OverlayEdge {
+            size_t to;
+            double time;
+            size_t shard;
+        };
+        std::vector<ShardConnection> shards_;
+        std::unordered_map<StopName, std::vector<size_t>> shards_by_stop_;
+        std::unordered_map<BusNumber, size_t> shard_by_bus_;
+        std::vector<StopName> boundary_stops_;
+        std::vector<std::vector<size_t>> boundary_by_shard_;
+        std::vector<std::vector<OverlayEdge>> overlay_edges_;
+        Json::Node Ask(size_t shard, std::map<std::string, Json::Node> request) const;
+        std::vector<std::vector<std::optional<double>>> AskMatrix(size_t shard, const std::vector<StopName>& from,
+                                                                  const std::vector<StopName>& to) const;
+        Json::Node GetRoute(const StopName& from, const StopName& to, size_t request_id) const;
+        Json::Node GetStop(const StopName& name, size_t request_id) const;
+    };
+
+    Json::Document ProcessStatRequests(const Json::Document& document, const Coordinator& coordinator);
+}
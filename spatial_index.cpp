@@ -0,0 +1,116 @@
+#include "spatial_index.h"
+
+#include <algorithm>
+#include <cmath>
+#include <queue>
+#include <tuple>
+
+namespace Points {
+    namespace {
+        void ToUnitVector(const Point& point, double (&coords)[3]) {
+            const double lat = point.latitude * rad_in_degree, lon = point.longitude * rad_in_degree;
+            coords[0] = std::cos(lat) * std::cos(lon);
+            coords[1] = std::cos(lat) * std::sin(lon);
+            coords[2] = std::sin(lat);
+        }
+        double SquaredChord(const double (&lhs)[3], const double (&rhs)[3]) {
+            double result = 0;
+            for (int axis = 0; axis < 3; ++axis) result += (lhs[axis] - rhs[axis]) * (lhs[axis] - rhs[axis]);
+            return result;
+        }
+        // pruning uses the chord with a margin, exact distances are computed by haversine
+        constexpr double chord_margin = 1e-9;
+    }
+
+    SpatialIndex::SpatialIndex(const std::vector<Point>& points) {
+        nodes_.resize(points.size());
+        geo_points_.reserve(points.size());
+        for (size_t id = 0; id < points.size(); ++id) {
+            ToUnitVector(points[id], nodes_[id].coords);
+            nodes_[id].id = static_cast<uint32_t>(id);
+            geo_points_.push_back(PrepareGeoPoint(points[id]));
+        }
+        Build(0, nodes_.size());
+    }
+    // the median of [begin, end) is stored in the middle, splitting along the axis of the widest spread
+    void SpatialIndex::Build(size_t begin, size_t end) {
+        if (end - begin <= 1) {
+            if (begin != end) nodes_[begin].axis = 0;
+            return;
+        }
+        double low[3] = {2, 2, 2}, high[3] = {-2, -2, -2};
+        for (size_t i = begin; i < end; ++i) {
+            for (int axis = 0; axis < 3; ++axis) {
+                low[axis] = std::min(low[axis], nodes_[i].coords[axis]);
+                high[axis] = std::max(high[axis], nodes_[i].coords[axis]);
+            }
+        }
+        uint8_t split_axis = 0;
+        for (uint8_t axis = 1; axis < 3; ++axis) {
+            if (high[axis] - low[axis] > high[split_axis] - low[split_axis]) split_axis = axis;
+        }
+        const size_t middle = begin + (end - begin) / 2;
+        std::nth_element(nodes_.begin() + begin, nodes_.begin() + middle, nodes_.begin() + end,
+                         [split_axis](const Node& lhs, const Node& rhs) { return lhs.coords[split_axis] < rhs.coords[split_axis]; });
+        nodes_[middle].axis = split_axis;
+        Build(begin, middle);
+        Build(middle + 1, end);
+    }
+    // visitor(node, squared_chord) may shrink bound, the squared chord beyond which nothing is needed
+    template <typename Visitor>
+    void SpatialIndex::Visit(size_t begin, size_t end, const double (&coords)[3], double& bound, Visitor& visitor) const {
+        if (begin >= end) return;
+        const size_t middle = begin + (end - begin) / 2;
+        const Node& node = nodes_[middle];
+        const double squared_chord = SquaredChord(node.coords, coords);
+        if (squared_chord <= bound) visitor(node, squared_chord);
+        const double delta = coords[node.axis] - node.coords[node.axis];
+        const bool is_left_first = delta < 0;
+        if (is_left_first) Visit(begin, middle, coords, bound, visitor); else Visit(middle + 1, end, coords, bound, visitor);
+        if (delta * delta <= bound) {
+            if (is_left_first) Visit(middle + 1, end, coords, bound, visitor); else Visit(begin, middle, coords, bound, visitor);
+        }
+    }
+    std::vector<SpatialIndex::Found> SpatialIndex::FindNearest(const Point& point, size_t count) const {
+        if (count == 0 || nodes_.empty()) return {};
+        double coords[3];
+        ToUnitVector(point, coords);
+        std::priority_queue<std::pair<double, uint32_t>> nearest;
+        double bound = 5; // squared chords never exceed 4
+        auto visitor = [&nearest, &bound, count](const Node& node, double squared_chord) {
+            nearest.emplace(squared_chord, node.id);
+            if (nearest.size() > count) nearest.pop();
+            if (nearest.size() == count) bound = nearest.top().first + chord_margin;
+        };
+        Visit(0, nodes_.size(), coords, bound, visitor);
+        const GeoPoint geo_point = PrepareGeoPoint(point);
+        std::vector<Found> result;
+        for (; !nearest.empty(); nearest.pop()) {
+            result.push_back({nearest.top().second, CalcLength(geo_point, geo_points_[nearest.top().second])});
+        }
+        std::sort(result.begin(), result.end(), [](const Found& lhs, const Found& rhs) {
+            return std::tie(lhs.distance, lhs.id) < std::tie(rhs.distance, rhs.id);
+        });
+        return result;
+    }
+    std::vector<SpatialIndex::Found> SpatialIndex::FindWithinRadius(const Point& point, double radius) const {
+        double coords[3];
+        ToUnitVector(point, coords);
+        const double half_angle = std::min(radius / (2 * earth_radius), std::asin(1.0));
+        double bound = 4 * std::sin(half_angle) * std::sin(half_angle) + chord_margin;
+        const GeoPoint geo_point = PrepareGeoPoint(point);
+        std::vector<Found> result;
+        auto visitor = [this, &result, &geo_point, radius](const Node& node, double) {
+            double distance = CalcLength(geo_point, geo_points_[node.id]);
+            if (distance <= radius) result.push_back({node.id, distance});
+        };
+        Visit(0, nodes_.size(), coords, bound, visitor);
+        std::sort(result.begin(), result.end(), [](const Found& lhs, const Found& rhs) {
+            return std::tie(lhs.distance, lhs.id) < std::tie(rhs.distance, rhs.id);
+        });
+        return result;
+    }
+    size_t SpatialIndex::GetMemoryUsage() const {
+        return nodes_.capacity() * sizeof(Node) + geo_points_.capacity() * sizeof(GeoPoint);
+    }
+}
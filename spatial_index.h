@@ -0,0 +1,43 @@
+#pragma once
+
+#ifndef CPPCOURSERA_SPATIAL_INDEX_H
+#define CPPCOURSERA_SPATIAL_INDEX_H
+
+#endif //CPPCOURSERA_SPATIAL_INDEX_H
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "point.h"
+
+namespace Points {
+    // Implicit k-d tree over points on the unit sphere. The chord between two points grows
+    // monotonically with the great-circle distance, so the tree prunes by chord and reports
+    // distances in metres through the same haversine formula as CalcLength.
+    class SpatialIndex {
+    public:
+        struct Found {
+            uint32_t id;
+            double distance;
+        };
+        SpatialIndex() = default;
+        // ids are the indexes of points in the vector
+        explicit SpatialIndex(const std::vector<Point>& points);
+        // sorted by distance
+        std::vector<Found> FindNearest(const Point& point, size_t count) const;
+        std::vector<Found> FindWithinRadius(const Point& point, double radius) const;
+        size_t GetMemoryUsage() const;
+    private:
+        struct Node {
+            double coords[3];
+            uint32_t id;
+            uint8_t axis;
+        };
+        std::vector<Node> nodes_;
+        std::vector<GeoPoint> geo_points_;
+        void Build(size_t begin, size_t end);
+        template <typename Visitor>
+        void Visit(size_t begin, size_t end, const double (&coords)[3], double& bound, Visitor& visitor) const;
+    };
+}
@@ -4,6 +4,18 @@
 #include "utils.h"
 #include "requests.h"
 #include "json.h"
+#include "json_schema.h"
+#include "server.h"
+#include "flat_database.h"
+#include "parallel.h"
+#include "spatial_index.h"
+#include "benchmark.h"
+#include "delta_stepping.h"
+#include "hub_labels.h"
+#include "overlay.h"
+#include "sharding.h"
+#include "graph_search.h"
+#include "name_table.h"
 #include <fstream>
 
 using namespace std;
@@ -103,6 +115,267 @@ void TestPoint() {
     }
 }
 
+void TestGeoTable() {
+    using namespace Points;
+    auto reference_length = [](const Point& lhs, const Point& rhs) {
+        double sin_la = std::sin((rhs.latitude - lhs.latitude) * rad_in_degree / 2);
+        double sin_lo = std::sin((rhs.longitude - lhs.longitude) * rad_in_degree / 2);
+        return 2 * earth_radius * std::asin(std::sqrt(sin_la * sin_la + sin_lo * sin_lo *
+                                                      std::cos(rhs.latitude * rad_in_degree) * std::cos(lhs.latitude * rad_in_degree)));
+    };
+    vector<Point> points;
+    GeoTable geo_table;
+    for (int i = 0; i < 23; ++i) {
+        points.push_back({Latitude(55.5 + 0.013 * i * (i % 3 - 1)), Longitude(37.5 - 0.007 * i)});
+        geo_table.Add(points.back());
+    }
+    points.push_back({Latitude(-33.9), Longitude(151.2)});
+    geo_table.Add(points.back());
+    vector<uint32_t> from, to;
+    for (uint32_t i = 0; i < points.size(); ++i) {
+        from.push_back(i);
+        to.push_back((i * 7 + 3) % points.size());
+    }
+    vector<double> lengths(from.size());
+    geo_table.CalcLengths(from.data(), to.data(), from.size(), lengths.data());
+    for (size_t i = 0; i < from.size(); ++i) {
+        double expected = reference_length(points[from[i]], points[to[i]]);
+        ASSERT(std::abs(lengths[i] - expected) <= 1e-9 * expected + 1e-6)
+        ASSERT_EQUAL(lengths[i], CalcLength(geo_table.Get(from[i]), geo_table.Get(to[i])))
+    }
+}
+
+void TestSpatialIndex() {
+    using namespace Points;
+    vector<Point> points;
+    for (int i = 0; i < 200; ++i) {
+        points.push_back({Latitude(55.6 + 0.0013 * ((i * 37) % 101)), Longitude(37.4 + 0.0021 * ((i * 53) % 97))});
+    }
+    points.push_back(points[5]);
+    SpatialIndex index(points);
+    for (int q = 0; q < 10; ++q) {
+        Point point{Latitude(55.58 + 0.017 * q), Longitude(37.39 + 0.023 * q)};
+        vector<pair<double, uint32_t>> expected;
+        for (uint32_t i = 0; i < points.size(); ++i) expected.emplace_back(CalcLength(point, points[i]), i);
+        sort(expected.begin(), expected.end());
+        auto nearest = index.FindNearest(point, 7);
+        ASSERT_EQUAL(nearest.size(), 7u)
+        for (size_t i = 0; i < nearest.size(); ++i) ASSERT_EQUAL(nearest[i].distance, expected[i].first)
+        double radius = 500 + 100 * q;
+        auto within = index.FindWithinRadius(point, radius);
+        size_t expected_count = count_if(expected.begin(), expected.end(), [radius](const auto& item) {
+            return item.first <= radius;
+        });
+        ASSERT_EQUAL(within.size(), expected_count)
+        for (size_t i = 0; i < within.size(); ++i) ASSERT_EQUAL(within[i].distance, expected[i].first)
+    }
+    ASSERT_EQUAL(index.FindNearest(points[0], 1000).size(), points.size())
+    ASSERT(SpatialIndex().FindNearest(points[0], 3).empty())
+}
+
+void TestNameTable() {
+    using namespace Transport;
+    vector<string> storage;
+    for (int i = 0; i < 1000; ++i) storage.push_back("Stop " + to_string(i * 7919 % 1000));
+    storage.push_back("");
+    vector<string_view> names(storage.begin(), storage.end());
+    NameTable table(names);
+    ASSERT_EQUAL(table.GetSize(), names.size())
+    for (uint32_t i = 0; i < names.size(); ++i) ASSERT_EQUAL(table.Find(names[i]).value_or(names.size()), i)
+    ASSERT(!table.Find("Stop 1000"))
+    ASSERT(!table.Find("Stop"))
+    ASSERT(!NameTable().Find("Stop 1"))
+    ASSERT(!NameTable(vector<string_view>{"Stop 1"}).Find(""))
+    names.push_back("Stop 5");
+    bool is_thrown = false;
+    try {
+        NameTable repeated(names);
+    } catch (const invalid_argument&) {
+        is_thrown = true;
+    }
+    ASSERT(is_thrown)
+}
+
+void TestReachability() {
+    using namespace Graph;
+    DirectedWeightedGraph<double> graph(40);
+    for (VertexId vertex = 0; vertex < 40; ++vertex) {
+        if (vertex % 7 != 6) graph.AddEdge({vertex, (vertex * 13 + 5) % 40, 1.0});
+        if (vertex % 5 == 0) graph.AddEdge({(vertex * 3 + 1) % 40, vertex, 1.0});
+    }
+    graph.AddEdge({0, 1, 1.0});
+    graph.AddEdge({1, 0, 1.0});
+    Reachability reachability(graph);
+    ASSERT(reachability.IsExact())
+    for (VertexId from = 0; from < 40; ++from) {
+        vector<bool> reached(40, false);
+        vector<VertexId> stack = {from};
+        reached[from] = true;
+        while (!stack.empty()) {
+            VertexId vertex = stack.back();
+            stack.pop_back();
+            for (EdgeId edge_id : graph.GetIncidentEdges(vertex)) {
+                VertexId to = graph.GetEdge(edge_id).to;
+                if (!reached[to]) {
+                    reached[to] = true;
+                    stack.push_back(to);
+                }
+            }
+        }
+        for (VertexId to = 0; to < 40; ++to) ASSERT_EQUAL(reachability.MayReach(from, to), reached[to])
+        ASSERT_EQUAL(reachability.CountReachable(from), static_cast<size_t>(count(reached.begin(), reached.end(), true)))
+    }
+}
+
+void TestDeltaStepping() {
+    using namespace Graph;
+    // wide enough for the frontiers to be relaxed by several threads, with zero-weight edges and ties
+    const size_t vertex_count = 4000;
+    DirectedWeightedGraph<uint32_t> graph(vertex_count);
+    for (VertexId vertex = 0; vertex < vertex_count; ++vertex) {
+        for (uint32_t i = 1; i <= 4; ++i) {
+            graph.AddEdge({vertex, static_cast<VertexId>((vertex * 7919 + i * 104729) % vertex_count), (vertex * i) % 13});
+        }
+    }
+    DijkstraSearch<uint32_t> dijkstra;
+    for (uint32_t delta : {1u, 5u, 1000u}) {
+        DeltaStepping<uint32_t> delta_stepping(graph, delta, 4);
+        for (VertexId source : {0u, 1234u}) {
+            delta_stepping.Run(source);
+            dijkstra.Start(vertex_count);
+            dijkstra.AddSource(source, 0);
+            dijkstra.Run(graph, [](VertexId, uint32_t) { return true; });
+            size_t mismatch_count = 0;
+            for (VertexId vertex = 0; vertex < vertex_count; ++vertex) {
+                if (delta_stepping.IsReached(vertex) != dijkstra.IsReached(vertex)) ++mismatch_count;
+                if (!dijkstra.IsReached(vertex)) continue;
+                if (delta_stepping.GetWeight(vertex) != dijkstra.GetWeight(vertex)) ++mismatch_count;
+                // the predecessor edges lead back to the source along tight edges
+                size_t step_count = 0;
+                for (VertexId current = vertex; current != source && step_count < vertex_count; ++step_count) {
+                    const auto& edge = graph.GetEdge(*delta_stepping.GetPrevEdge(current));
+                    if (edge.to != current || delta_stepping.GetWeight(edge.from) + edge.weight != delta_stepping.GetWeight(current)) {
+                        ++mismatch_count;
+                    }
+                    current = edge.from;
+                }
+                if (step_count == vertex_count) ++mismatch_count;
+            }
+            ASSERT_EQUAL(mismatch_count, 0u)
+        }
+    }
+}
+
+void TestHubLabels() {
+    using namespace Graph;
+    const size_t vertex_count = 200;
+    DirectedWeightedGraph<uint32_t> graph(vertex_count);
+    for (VertexId vertex = 0; vertex < vertex_count; ++vertex) {
+        for (uint32_t i = 1; i <= 3; ++i) {
+            graph.AddEdge({vertex, static_cast<VertexId>((vertex * 7919 + i * 104729) % vertex_count), (vertex * i) % 13});
+        }
+    }
+    graph.AddEdge({0, 0, 5});
+    HubLabels<uint32_t> labels(graph);
+    ASSERT(labels.GetEntryCount() >= 2 * vertex_count)
+    ASSERT(labels.GetMemoryUsage() > 0)
+    DijkstraSearch<uint32_t> dijkstra;
+    size_t mismatch_count = 0;
+    for (VertexId source = 0; source < vertex_count; source += 37) {
+        dijkstra.Start(vertex_count);
+        dijkstra.AddSource(source, 0);
+        dijkstra.Run(graph, [](VertexId, uint32_t) { return true; });
+        for (VertexId target = 0; target < vertex_count; ++target) {
+            const auto weight = labels.GetWeight(source, target);
+            const auto path = labels.GetPath(source, target);
+            if (weight.has_value() != dijkstra.IsReached(target) || path.has_value() != weight.has_value()) ++mismatch_count;
+            if (!weight || !path) continue;
+            if (*weight != dijkstra.GetWeight(target)) ++mismatch_count;
+            // the expanded path is connected and as long as the label distance
+            VertexId current = source;
+            uint32_t path_weight = 0;
+            for (EdgeId edge_id : *path) {
+                const auto& edge = graph.GetEdge(edge_id);
+                if (edge.from != current) ++mismatch_count;
+                current = edge.to;
+                path_weight += edge.weight;
+            }
+            if (current != target || path_weight != *weight) ++mismatch_count;
+        }
+    }
+    ASSERT_EQUAL(mismatch_count, 0u)
+}
+
+void TestOverlay() {
+    using namespace Graph;
+    const size_t vertex_count = 400;
+    DirectedWeightedGraph<uint32_t> graph(vertex_count);
+    for (VertexId vertex = 0; vertex < vertex_count; ++vertex) {
+        graph.AddEdge({vertex, static_cast<VertexId>((vertex + 1) % vertex_count), vertex % 7});
+        graph.AddEdge({vertex, static_cast<VertexId>((vertex * 7919 + 104729) % vertex_count), (vertex * 3) % 13 + 5});
+    }
+    Overlay<uint32_t> overlay(graph, 16);
+    ASSERT(overlay.GetCellCount() >= vertex_count / 16)
+    ASSERT(overlay.GetBoundaryVertexCount() > 0)
+    DijkstraSearch<uint32_t> dijkstra;
+    Overlay<uint32_t>::Search search;
+    auto count_mismatches = [&] {
+        size_t mismatch_count = 0;
+        for (VertexId source = 0; source < vertex_count; source += 97) {
+            dijkstra.Start(vertex_count);
+            dijkstra.AddSource(source, 0);
+            dijkstra.Run(graph, [](VertexId, uint32_t) { return true; });
+            for (VertexId target = 0; target < vertex_count; target += 7) {
+                const auto path = overlay.FindRoute(source, target, search);
+                if (path.has_value() != dijkstra.IsReached(target)) ++mismatch_count;
+                if (!path) continue;
+                VertexId current = source;
+                uint32_t path_weight = 0;
+                for (EdgeId edge_id : *path) {
+                    const auto& edge = graph.GetEdge(edge_id);
+                    if (edge.from != current) ++mismatch_count;
+                    current = edge.to;
+                    path_weight += edge.weight;
+                }
+                if (current != target || path_weight != dijkstra.GetWeight(target)) ++mismatch_count;
+            }
+        }
+        return mismatch_count;
+    };
+    ASSERT_EQUAL(count_mismatches(), 0u)
+    // new weights on the same structure
+    for (EdgeId edge_id = 0; edge_id < graph.GetEdgeCount(); ++edge_id) {
+        const auto& edge = graph.GetEdge(edge_id);
+        graph.SetEdge(edge_id, {edge.from, edge.to, (edge.weight * 5 + edge_id) % 17});
+    }
+    overlay.Customize(graph);
+    ASSERT_EQUAL(count_mismatches(), 0u)
+}
+
+void TestRouteTime() {
+    using namespace Transport;
+    ASSERT_EQUAL(ToRouteTime(24.21), 242100u)
+    ASSERT_EQUAL(FromRouteTime(ToRouteTime(8.31)), 8.31)
+    ASSERT_EQUAL(ToRouteTime(0.), 0u)
+    for (double minutes : {-1., 1e6, numeric_limits<double>::quiet_NaN()}) {
+        bool is_thrown = false;
+        try {
+            ToRouteTime(minutes);
+        } catch (const overflow_error&) {
+            is_thrown = true;
+        }
+        ASSERT(is_thrown)
+    }
+    ASSERT_EQUAL(Graph::AddWeights<RouteTime>(1, 2), 3u)
+    bool is_thrown = false;
+    try {
+        Graph::AddWeights<RouteTime>(numeric_limits<RouteTime>::max() - 1, 2);
+    } catch (const overflow_error&) {
+        is_thrown = true;
+    }
+    ASSERT(is_thrown)
+}
+
 void TestNode() {
     using namespace Json;
     Node node = vector<Node> {"hello"s, 14, vector<Node> {"world"s}, 15.65, false, true};
@@ -155,6 +428,157 @@ void TestJson() {
     ostringstream output;
     Print(Load(input), output);
     ASSERT_EQUAL(output.str(), input_str)
+    {
+        ostringstream compact;
+        PrintCompact(Load(string_view("[1, null, [null]]")).GetRoot(), compact);
+        ASSERT_EQUAL(compact.str(), "[1,null,[null]]")
+    }
+    {
+        // an integer too large for an int is read as a double, a malformed number is an error
+        const Document large = Load(string_view("[12345678901234, -99999999999]"));
+        ASSERT_EQUAL(large.GetRoot().AsArray()[0].AsDouble(), 12345678901234.0)
+        ASSERT_EQUAL(large.GetRoot().AsArray()[1].AsDouble(), -99999999999.0)
+        for (string text : {"[-]", "[1e]", "[1.5e+]"}) {
+            bool is_rejected = false;
+            try {
+                Load(string_view(text));
+            } catch (const runtime_error&) {
+                is_rejected = true;
+            }
+            ASSERT(is_rejected)
+        }
+    }
+}
+
+void TestJsonSources() {
+    using namespace Json;
+    string str = "{\"a\": [1, -2.5, true, false, \"x y\"],\n \"b\": {}}  tail";
+    ostringstream from_memory, from_stream;
+    PrintCompact(Load(string_view(str)).GetRoot(), from_memory);
+    istringstream input(str);
+    PrintCompact(Load(input).GetRoot(), from_stream);
+    ASSERT_EQUAL(from_memory.str(), "{\"a\":[1,-2.5,true,false,\"x y\"],\"b\":{}}")
+    ASSERT_EQUAL(from_stream.str(), from_memory.str())
+    string rest;
+    getline(input, rest);
+    ASSERT_EQUAL(rest, "  tail")
+    istringstream whole(str);
+    ASSERT_EQUAL(ReadAll(whole), str)
+    ostringstream exact;
+    PrintExact(Node(vector<Node>{0.1 + 0.2, 55.611087, -1.5e-300, 7}), exact);
+    const string exact_text = exact.str();
+    const Document exact_document = Load(string_view(exact_text));
+    const auto& numbers = exact_document.GetRoot().AsArray();
+    ASSERT(numbers[0].AsDouble() == 0.1 + 0.2 && numbers[1].AsDouble() == 55.611087 && numbers[2].AsDouble() == -1.5e-300)
+    ASSERT_EQUAL(numbers[3].AsInt(), 7)
+}
+
+void TestRequestBatches() {
+    using namespace Transport;
+    using namespace Requests;
+    ifstream input("examples/example_2.in");
+    string document;
+    getline(input, document, '\0');
+    const string settings = "\"routing_settings\": {", stat_requests = "\"stat_requests\": [";
+    document.insert(document.find(settings) + settings.size(), "\"engine\": \"dijkstra\", ");
+    document.insert(document.find(stat_requests) + stat_requests.size(),
+                    R"({"type": "Route", "from": "Biryulyovo Zapadnoye", "to": "Universam", "id": 101},
+                       {"type": "Metrics", "id": 102},
+                       {"type": "Bus", "name": "297", "id": 103},
+                       {"type": "Route", "from": "Biryulyovo Zapadnoye", "to": "Biryusinka", "id": 104},
+                       {"type": "Metrics", "id": 105},)");
+    const RequestBatches requests = ParseRequests(Json::Load(string_view(document)));
+    ASSERT_EQUAL(requests.stops.size(), 11u)
+    ASSERT_EQUAL(requests.buses.size(), 4u)
+    ASSERT_EQUAL(std::get<Batch<GetRouteRequest>>(requests.stat_requests).size(), 9u)
+    ASSERT_EQUAL(std::get<Batch<GetMetricsRequest>>(requests.stat_requests).size(), 2u)
+    ASSERT_EQUAL(std::get<Batch<GetMetricsRequest>>(requests.stat_requests)[1].second, 4u)
+    TransportDatabase tdb;
+    const Json::Document result = ProcessRequests(requests, tdb);
+    const auto& responses = result.GetRoot().AsArray();
+    ASSERT_EQUAL(responses.size(), requests.stat_request_count)
+    for (size_t i = 0; i < 5; ++i) {
+        ASSERT_EQUAL(responses[i].AsMap().at("request_id").AsInt(), static_cast<int>(101 + i))
+    }
+    // a Metrics request sees the searches of the requests before it only
+    ASSERT_EQUAL(responses[1].AsMap().at("route_searches").AsInt(), 1)
+    ASSERT_EQUAL(responses[4].AsMap().at("route_searches").AsInt(), 2)
+}
+
+struct SchemaSample {
+    int count{0};
+    vector<string> names;
+    optional<double> ratio;
+};
+
+void TestJsonSchema() {
+    using namespace Json;
+    const auto schema = MakeSchema<SchemaSample>(Required("count", &SchemaSample::count), Required("names", &SchemaSample::names),
+                                                 Optional("ratio", &SchemaSample::ratio));
+    const SchemaSample sample = schema.Decode(Load(string_view(R"({"names": ["a", "b"], "count": 3, "other": null})")).GetRoot());
+    ASSERT_EQUAL(sample.count, 3)
+    ASSERT_EQUAL(sample.names, (vector<string>{"a", "b"}))
+    ASSERT(!sample.ratio)
+    ASSERT_EQUAL(*schema.Decode(Load(string_view(R"({"names": [], "count": 0, "ratio": 2})")).GetRoot()).ratio, 2.0)
+    auto error_field = [](const auto& decode) -> string {
+        try {
+            decode();
+        } catch (const SchemaError& error) {
+            return error.GetField();
+        }
+        return "no error";
+    };
+    ASSERT_EQUAL(error_field([&] { schema.Decode(Load(string_view(R"({"names": []})")).GetRoot()); }), "count")
+    ASSERT_EQUAL(error_field([&] { schema.Decode(Load(string_view(R"({"names": ["a", 1], "count": 1})")).GetRoot()); }), "names[1]")
+    ASSERT_EQUAL(error_field([&] { schema.Decode(Load(string_view(R"({"names": [], "count": 1.5})")).GetRoot()); }), "count")
+    using namespace Transport::Requests;
+    const Document route = Load(string_view(R"({"type": "Route", "id": 1, "from": {"latitude": "north", "longitude": 37.6}, "to": {}})"));
+    ASSERT_EQUAL(error_field([&] { ParseStatRequest(route.GetRoot()); }), "from.latitude")
+    const Document reachable = Load(string_view(R"({"type": "Reachable", "id": 2, "from": "Universam", "time": 4.5})"));
+    const auto request = get<GetReachableStopsRequest>(ParseStatRequest(reachable.GetRoot()));
+    ASSERT_EQUAL(request.id, 2u)
+    ASSERT_EQUAL(request.from, "Universam")
+    ASSERT_EQUAL(request.max_time, 4.5)
+}
+
+void TestExampleFile() {
+    using namespace Transport;
+    TransportDatabase tdb;
+    ostringstream output;
+    Json::Print(Requests::ProcessRequests(Requests::ParseRequests(Json::LoadFile("examples/example_2.in")), tdb), output);
+    ifstream i_expected("examples/example_2.out");
+    string expected;
+    getline(i_expected, expected, '\0');
+    ASSERT_EQUAL(output.str(), expected)
+}
+
+void TestParallelFor() {
+    vector<int> values(1000);
+    ParallelFor(values.size(), [&values](size_t i) { values[i] = static_cast<int>(i) * 2; }, 4);
+    for (size_t i = 0; i < values.size(); ++i) ASSERT_EQUAL(values[i], static_cast<int>(i) * 2)
+    bool is_thrown = false;
+    try {
+        ParallelFor(values.size(), [](size_t i) { if (i == 777) throw invalid_argument("777"); }, 4);
+    } catch (const invalid_argument&) {
+        is_thrown = true;
+    }
+    ASSERT(is_thrown)
+
+    // the same threads serve every round, including one after an exception and rounds smaller than the team
+    WorkerTeam team(4);
+    is_thrown = false;
+    try {
+        team.Run(values.size(), [](size_t i) { if (i == 777) throw invalid_argument("777"); });
+    } catch (const invalid_argument&) {
+        is_thrown = true;
+    }
+    ASSERT(is_thrown)
+    for (size_t round = 0; round < 100; ++round) {
+        const size_t count = round % 7;
+        vector<int> counts(count);
+        team.Run(count, [&counts](size_t i) { ++counts[i]; });
+        ASSERT_EQUAL(counts, vector<int>(count, 1))
+    }
 }
 
 void TestExample(string path_input, string path_output) {
@@ -187,14 +611,581 @@ void TestExample4() {
     TestExample("examples/transport_input4.json", "examples/transport_output4.json");
 }
 
+string ReadFile(const string& path) {
+    ifstream input(path);
+    string text;
+    getline(input, text, '\0');
+    return text;
+}
+
+// the document with settings_json put first in its routing_settings, as in "\"engine\": \"dijkstra\", "
+string InsertRoutingSettings(string document, const string& settings_json) {
+    const string settings = "\"routing_settings\": {";
+    document.insert(document.find(settings) + settings.size(), settings_json);
+    return document;
+}
+
+unique_ptr<Transport::TransportDatabase> BuildDatabase(const string& document, const string& settings_json = "") {
+    auto tdb = make_unique<Transport::TransportDatabase>();
+    const string settings_document = InsertRoutingSettings(document, settings_json);
+    Transport::Requests::ProcessRequests(Transport::Requests::ParseBaseRequests(Json::Load(string_view(settings_document))), *tdb);
+    return tdb;
+}
+
+// the stops of examples/example_2.in, two networks of 9 and 2 stops
+const vector<Transport::StopName> example_2_stops = {
+        "Biryulyovo Zapadnoye", "Universam", "Biryulyovo Tovarnaya", "Biryusinka", "Apteka", "TETs 26",
+        "Pokrovskaya", "Rossoshanskaya ulitsa", "Prazhskaya", "Tolstopaltsevo", "Rasskazovka"};
+
+// routes between the stops of example 2 that one database finds and the other doesn't, or finds with another total_time
+size_t CountRouteMismatches(const Transport::TransportDatabase& expected, const Transport::TransportDatabase& tdb) {
+    size_t mismatch_count = 0;
+    for (const auto& from : example_2_stops) {
+        for (const auto& to : example_2_stops) {
+            auto expected_route = expected.GetRoute(from, to, 0), route = tdb.GetRoute(from, to, 0);
+            if (route.AsMap().count("total_time") != expected_route.AsMap().count("total_time")) {
+                ++mismatch_count;
+            } else if (expected_route.AsMap().count("total_time") != 0 &&
+                       abs(route.AsMap().at("total_time").AsDouble() - expected_route.AsMap().at("total_time").AsDouble()) > 1e-9) {
+                ++mismatch_count;
+            }
+        }
+    }
+    return mismatch_count;
+}
+
+void TestMemoryUsage() {
+    using namespace Transport;
+    using namespace Requests;
+    {
+        ifstream input("examples/example_1.in");
+        TransportDatabase tdb;
+        ProcessRequests(ParseRequests(Json::Load(input)), tdb);
+        TransportDatabase::MemoryUsage memory_usage = tdb.GetMemoryUsage();
+        ASSERT(memory_usage.stop_by_name > 0)
+        ASSERT(memory_usage.stop_distances > 0)
+        ASSERT(memory_usage.graph_edges > 0)
+        ASSERT(memory_usage.router_routes > 0)
+        ASSERT_EQUAL(tdb.GetMemoryUsage(7).AsMap().at("request_id").AsInt(), 7)
+    }
+    {
+        ifstream input("examples/example_1.in");
+        TransportDatabase tdb;
+        tdb.AddMemorySettings({1024, false});
+        bool is_thrown = false;
+        try {
+            ProcessRequests(ParseRequests(Json::Load(input)), tdb);
+        } catch (const runtime_error& error) {
+            is_thrown = string(error.what()).find("memory budget exceeded") == 0;
+        }
+        ASSERT(is_thrown)
+    }
+}
+
+void TestStopQueries() {
+    using namespace Transport;
+    using namespace Requests;
+    ifstream input("examples/example_1.in");
+    TransportDatabase tdb;
+    ProcessRequests(ParseRequests(Json::Load(input)), tdb);
+    stringstream query(R"({"id": 1, "type": "NearestStops", "latitude": 55.5875, "longitude": 37.6456, "count": 2})");
+    auto request = ParseStatRequest(Json::Load(query).GetRoot());
+    auto result = Process(request, tdb);
+    const auto& nearest = result.AsMap().at("stops").AsArray();
+    ASSERT_EQUAL(nearest.size(), 2u)
+    ASSERT_EQUAL(nearest[0].AsMap().at("stop_name").AsString(), "Universam")
+    ASSERT_EQUAL(nearest[0].AsMap().at("buses").AsArray().size(), 2u)
+    ASSERT_EQUAL(nearest[1].AsMap().at("stop_name").AsString(), "Biryulyovo Tovarnaya")
+    query = stringstream(R"({"id": 2, "type": "StopsInRadius", "latitude": 55.574371, "longitude": 37.6517, "radius": 1000})");
+    request = ParseStatRequest(Json::Load(query).GetRoot());
+    result = Process(request, tdb);
+    ASSERT_EQUAL(result.AsMap().at("request_id").AsInt(), 2)
+    ASSERT_EQUAL(result.AsMap().at("stops").AsArray().size(), 1u)
+    ASSERT_EQUAL(result.AsMap().at("stops").AsArray()[0].AsMap().at("distance").AsDouble(), 0.0)
+}
+
+void TestPointRoute() {
+    using namespace Transport;
+    using namespace Requests;
+    ifstream input("examples/example_2.in");
+    TransportDatabase tdb;
+    ProcessRequests(ParseRequests(Json::Load(input)), tdb);
+    const double pedestrian_velocity = 5 * 50. / 3;
+    const vector<Points::Point> points = {{Points::Latitude(55.574371), Points::Longitude(37.6517)},
+                                          {Points::Latitude(55.611717), Points::Longitude(37.603938)},
+                                          {Points::Latitude(55.58), Points::Longitude(37.64)},
+                                          {Points::Latitude(55.595), Points::Longitude(37.62)}};
+    for (const auto& from : points) {
+        for (const auto& to : points) {
+            double expected = Points::CalcLength(from, to) / pedestrian_velocity;
+            const Json::Node origins = tdb.GetNearestStops(from, 4, 0), targets = tdb.GetNearestStops(to, 4, 0);
+            for (const auto& origin : origins.AsMap().at("stops").AsArray()) {
+                for (const auto& target : targets.AsMap().at("stops").AsArray()) {
+                    const auto& origin_name = origin.AsMap().at("stop_name").AsString();
+                    const auto& target_name = target.AsMap().at("stop_name").AsString();
+                    double walk_time = (origin.AsMap().at("distance").AsDouble() + target.AsMap().at("distance").AsDouble()) / pedestrian_velocity;
+                    if (origin_name == target_name) {
+                        expected = min(expected, walk_time);
+                        continue;
+                    }
+                    auto route = tdb.GetRoute(origin_name, target_name, 0);
+                    if (route.AsMap().count("total_time") != 0)
+                        expected = min(expected, walk_time + route.AsMap().at("total_time").AsDouble());
+                }
+            }
+            auto result = tdb.GetRoute(from, to, 5);
+            ASSERT(abs(result.AsMap().at("total_time").AsDouble() - expected) < 1e-9)
+            const auto& items = result.AsMap().at("items").AsArray();
+            ASSERT_EQUAL(items.front().AsMap().at("type").AsString(), "Walk")
+            ASSERT_EQUAL(items.back().AsMap().at("type").AsString(), "Walk")
+        }
+    }
+    stringstream query(R"({"id": 3, "type": "Route", "from": {"latitude": 55.574371, "longitude": 37.6517}, "to": {"latitude": 55.611717, "longitude": 37.603938}})");
+    auto request = ParseStatRequest(Json::Load(query).GetRoot());
+    ASSERT(holds_alternative<GetPointRouteRequest>(request))
+    auto result = Process(request, tdb);
+    const auto& items = result.AsMap().at("items").AsArray();
+    ASSERT_EQUAL(items[0].AsMap().at("stop_name").AsString(), "Biryulyovo Zapadnoye")
+    ASSERT_EQUAL(items[0].AsMap().at("distance").AsDouble(), 0.0)
+    ASSERT_EQUAL(items[1].AsMap().at("type").AsString(), "Wait")
+    ASSERT_EQUAL(items.back().AsMap().at("stop_name").AsString(), "Prazhskaya")
+}
+
+void TestMatrix() {
+    using namespace Transport;
+    using namespace Requests;
+    ifstream input("examples/example_2.in");
+    TransportDatabase tdb;
+    ProcessRequests(ParseRequests(Json::Load(input)), tdb);
+    const vector<StopName> stops = {"Biryulyovo Zapadnoye", "Universam", "Prazhskaya", "Tolstopaltsevo", "Universam"};
+    const vector<StopName> targets = {"Rasskazovka", "Prazhskaya", "Apteka", "Biryulyovo Zapadnoye"};
+    auto result = tdb.GetMatrix(stops, targets, 4);
+    ASSERT_EQUAL(result.AsMap().at("request_id").AsInt(), 4)
+    const auto& rows = result.AsMap().at("total_times").AsArray();
+    ASSERT_EQUAL(rows.size(), stops.size())
+    for (size_t i = 0; i < stops.size(); ++i) {
+        const auto& row = rows[i].AsArray();
+        ASSERT_EQUAL(row.size(), targets.size())
+        for (size_t j = 0; j < targets.size(); ++j) {
+            auto route = tdb.GetRoute(stops[i], targets[j], 0);
+            if (route.AsMap().count("total_time") == 0) {
+                ASSERT(row[j].IsNull())
+            } else {
+                ASSERT(abs(row[j].AsDouble() - route.AsMap().at("total_time").AsDouble()) < 1e-9)
+            }
+        }
+    }
+    ASSERT(rows[3].AsArray()[0].AsDouble() > 0)
+    ASSERT(rows[3].AsArray()[1].IsNull())
+    ASSERT_EQUAL(tdb.GetMatrix({"Universam"}, {"Nowhere"}, 1).AsMap().count("error_message"), 1u)
+}
+
+void TestReachableStops() {
+    using namespace Transport;
+    using namespace Requests;
+    ifstream input("examples/example_2.in");
+    TransportDatabase tdb;
+    ProcessRequests(ParseRequests(Json::Load(input)), tdb);
+    const vector<StopName> stops = {"Biryulyovo Zapadnoye", "Universam", "Biryulyovo Tovarnaya", "Biryusinka", "Apteka",
+                                    "TETs 26", "Pokrovskaya", "Rossoshanskaya ulitsa", "Prazhskaya", "Tolstopaltsevo", "Rasskazovka"};
+    for (double max_time : {0., 5., 12.5, 30., 1000.}) {
+        auto result = tdb.GetReachableStops("Universam", max_time, 2);
+        const auto& reachable = result.AsMap().at("stops").AsArray();
+        map<string, double> time_by_stop;
+        for (size_t i = 0; i < reachable.size(); ++i) {
+            time_by_stop[reachable[i].AsMap().at("stop_name").AsString()] = reachable[i].AsMap().at("time").AsDouble();
+            if (i > 0) ASSERT(reachable[i - 1].AsMap().at("time").AsDouble() <= reachable[i].AsMap().at("time").AsDouble())
+        }
+        ASSERT_EQUAL(time_by_stop.size(), reachable.size())
+        for (const auto& stop : stops) {
+            auto route = tdb.GetRoute("Universam", stop, 0);
+            const bool is_reachable = route.AsMap().count("total_time") != 0 && route.AsMap().at("total_time").AsDouble() <= max_time;
+            ASSERT_EQUAL(time_by_stop.count(stop), static_cast<size_t>(is_reachable))
+            if (is_reachable) ASSERT(abs(time_by_stop[stop] - route.AsMap().at("total_time").AsDouble()) < 1e-9)
+        }
+    }
+    ASSERT_EQUAL(tdb.GetReachableStops("Nowhere", 10, 1).AsMap().count("error_message"), 1u)
+}
+
+void TestDijkstraEngine() {
+    using namespace Transport;
+    using namespace Requests;
+    for (string engine_settings : {"\"engine\": \"dijkstra\", ", "\"table_algorithm\": \"delta_stepping\", "}) {
+        for (string example : {"1", "2", "3"}) {
+            const string document = InsertRoutingSettings(ReadFile("examples/example_" + example + ".in"), engine_settings);
+            ostringstream output;
+            TransportDatabase tdb;
+            Json::Print(ProcessRequests(ParseRequests(Json::Load(string_view(document))), tdb), output);
+            ASSERT_EQUAL(tdb.GetMemoryUsage().router_routes == 0, engine_settings.find("dijkstra") != string::npos)
+            ASSERT_EQUAL(output.str(), ReadFile("examples/example_" + example + ".out"))
+        }
+    }
+}
+
+void TestAltEngine() {
+    using namespace Transport;
+    using namespace Requests;
+    const string document = ReadFile("examples/example_2.in");
+    auto table = BuildDatabase(document), dijkstra = BuildDatabase(document, "\"engine\": \"dijkstra\", "),
+         alt = BuildDatabase(document, "\"engine\": \"alt\", ");
+    ASSERT(alt->GetMemoryUsage().landmarks > 0)
+    ASSERT_EQUAL(CountRouteMismatches(*table, *alt), 0u)
+    ASSERT_EQUAL(CountRouteMismatches(*table, *dijkstra), 0u)
+    auto alt_metrics = alt->GetMetrics(0), dijkstra_metrics = dijkstra->GetMetrics(0);
+    // routes between the two networks of the example are answered without a search
+    ASSERT_EQUAL(alt_metrics.AsMap().at("route_searches").AsInt(), 9 * 9 + 2 * 2)
+    ASSERT(alt_metrics.AsMap().at("settled_vertices").AsInt() < dijkstra_metrics.AsMap().at("settled_vertices").AsInt())
+}
+
+void TestRouteBudget() {
+    using namespace Transport;
+    using namespace Requests;
+    const auto database = BuildDatabase(ReadFile("examples/example_2.in"), "\"engine\": \"dijkstra\", ");
+    const TransportDatabase& tdb = *database;
+    auto to_string = [](const Json::Node& node) {
+        ostringstream output;
+        Json::PrintCompact(node, output);
+        return output.str();
+    };
+    size_t non_optimal = 0, unanswered = 0;
+    for (const auto& from : example_2_stops) {
+        for (const auto& to : example_2_stops) {
+            const auto expected = tdb.GetRoute(from, to, 0);
+            ASSERT_EQUAL(to_string(tdb.GetRoute(from, to, 0, RouteBudget{1000, nullopt})), to_string(expected))
+            for (size_t settled_vertices : {1, 4, 16}) {
+                const auto route = tdb.GetRoute(from, to, 0, RouteBudget{settled_vertices, nullopt});
+                const auto& route_map = route.AsMap();
+                if (route_map.count("total_time") == 0) {
+                    if (route_map.at("error_message").AsString() == "budget exhausted") ++unanswered;
+                    else ASSERT_EQUAL(to_string(route), to_string(expected))
+                } else if (route_map.count("is_optimal") != 0) {
+                    ASSERT(route_map.at("total_time").AsDouble() >= expected.AsMap().at("total_time").AsDouble() - 1e-9)
+                    ++non_optimal;
+                } else {
+                    ASSERT_EQUAL(route_map.at("total_time").AsDouble(), expected.AsMap().at("total_time").AsDouble())
+                }
+            }
+        }
+    }
+    ASSERT(non_optimal > 0)
+    ASSERT(unanswered > 0)
+    const auto metrics = tdb.GetMetrics(0);
+    ASSERT_EQUAL(static_cast<size_t>(metrics.AsMap().at("route_budget_exhaustions").AsInt()), non_optimal + unanswered)
+    ASSERT_EQUAL(static_cast<size_t>(metrics.AsMap().at("route_budget_unanswered").AsInt()), unanswered)
+
+    stringstream query(R"({"id": 1, "type": "Route", "from": "Universam", "to": "Apteka", "budget": {"microseconds": 500}})");
+    const Json::Document query_document = Json::Load(query);
+    const auto request = get<GetRouteRequest>(ParseStatRequest(query_document.GetRoot()));
+    ASSERT(!request.budget.settled_vertices)
+    ASSERT_EQUAL(request.budget.microseconds.value_or(0), 500u)
+}
+
+void TestHubLabelsEngine() {
+    using namespace Transport;
+    using namespace Requests;
+    const string document = ReadFile("examples/example_2.in");
+    auto table = BuildDatabase(document), hub_labels = BuildDatabase(document, "\"engine\": \"hub_labels\", ");
+    ASSERT(hub_labels->GetMemoryUsage().hub_labels > 0)
+    ASSERT_EQUAL(hub_labels->GetMemoryUsage().router_routes, 0u)
+    ASSERT_EQUAL(CountRouteMismatches(*table, *hub_labels), 0u)
+    const vector<StopName>& stops = example_2_stops;
+    const auto matrix = hub_labels->GetMatrix({"Biryulyovo Zapadnoye"}, stops, 1);
+    const auto& row = matrix.AsMap().at("total_times").AsArray()[0].AsArray();
+    for (size_t j = 0; j < stops.size(); ++j) {
+        auto expected = table->GetRoute("Biryulyovo Zapadnoye", stops[j], 0);
+        if (expected.AsMap().count("total_time") == 0) {
+            ASSERT(row[j].IsNull())
+        } else {
+            ASSERT(abs(row[j].AsDouble() - expected.AsMap().at("total_time").AsDouble()) < 1e-9)
+        }
+    }
+    auto metrics = hub_labels->GetMetrics(0);
+    ASSERT(metrics.AsMap().at("hub_label_entries").AsInt() > 0)
+    // routes between the two networks of the example are answered without a lookup
+    ASSERT_EQUAL(metrics.AsMap().at("hub_label_queries").AsInt(), 9 * 9 + 2 * 2 + 11)
+    ASSERT_EQUAL(metrics.AsMap().at("route_searches").AsInt(), 0)
+}
+
+void TestOverlayEngine() {
+    using namespace Transport;
+    using namespace Requests;
+    string document = ReadFile("examples/example_2.in");
+    auto table = BuildDatabase(document), overlay = BuildDatabase(document, "\"engine\": \"overlay\", \"overlay_cell_size\": 4, ");
+    ASSERT(overlay->GetMemoryUsage().overlay > 0)
+    ASSERT_EQUAL(CountRouteMismatches(*table, *overlay), 0u)
+    auto metrics = overlay->GetMetrics(0);
+    ASSERT(metrics.AsMap().at("overlay_cells").AsInt() > 1)
+    ASSERT(metrics.AsMap().at("overlay_boundary_vertices").AsInt() > 0)
+
+    // the same settings and distances built from scratch
+    RouteSettings route_settings;
+    route_settings.bus_wait_time = 5;
+    route_settings.bus_velocity = 45 * 50. / 3;
+    overlay->SetRoadDistance("Universam", "Biryulyovo Tovarnaya", 2400);
+    // declared only from Universam, the reverse distance follows it
+    overlay->SetRoadDistance("Universam", "Biryusinka", 3000);
+    overlay->CustomizeRoutes(route_settings);
+    for (const auto& [old_text, new_text] : {pair<string, string>{"\"bus_wait_time\": 2", "\"bus_wait_time\": 5"},
+                                             {"\"bus_velocity\": 30", "\"bus_velocity\": 45"},
+                                             {"\"Biryulyovo Tovarnaya\": 1380", "\"Biryulyovo Tovarnaya\": 2400"},
+                                             {"\"Biryusinka\": 760", "\"Biryusinka\": 3000"}}) {
+        ASSERT(document.find(old_text) != string::npos)
+        document.replace(document.find(old_text), old_text.size(), new_text);
+    }
+    auto expected = BuildDatabase(document);
+    ASSERT(CountRouteMismatches(*table, *expected) != 0)
+    ASSERT_EQUAL(CountRouteMismatches(*expected, *overlay), 0u)
+    for (const string bus : {"297", "635", "828"}) {
+        ASSERT_EQUAL(overlay->GetBus(bus, 0).AsMap().at("route_length").AsInt(), expected->GetBus(bus, 0).AsMap().at("route_length").AsInt())
+    }
+    for (const auto& [from, to] : {pair<string, string>{"Universam", "Biryusinka"}, {"Biryusinka", "Universam"}}) {
+        ASSERT_EQUAL(overlay->GetRoute(from, to, 0).AsMap().at("total_time").AsDouble(),
+                     expected->GetRoute(from, to, 0).AsMap().at("total_time").AsDouble())
+    }
+}
+
+void TestSharding() {
+    using namespace Transport;
+    using namespace Requests;
+    const Json::Document document = Json::LoadFile("examples/example_2.in");
+    TransportDatabase expected;
+    ProcessRequests(ParseBaseRequests(document), expected);
+    const vector<StopName> stops = {"Biryulyovo Zapadnoye", "Universam", "Biryulyovo Tovarnaya", "Biryusinka", "Apteka",
+                                    "TETs 26", "Pokrovskaya", "Rossoshanskaya ulitsa", "Prazhskaya", "Tolstopaltsevo", "Rasskazovka"};
+    auto text = [](const Json::Node& node) {
+        ostringstream output;
+        Json::PrintCompact(node, output);
+        return output.str();
+    };
+    for (size_t region_count : {2u, 3u}) {
+        Sharding::Regions regions = Sharding::SplitBase(document, region_count);
+        ASSERT_EQUAL(regions.bases.size(), region_count)
+        // shards in this process, answering the way --serve does
+        vector<unique_ptr<TransportDatabase>> shards;
+        vector<Sharding::ShardConnection> connections;
+        for (const auto& base : regions.bases) {
+            shards.push_back(make_unique<TransportDatabase>());
+            ProcessRequests(ParseBaseRequests(base), *shards.back());
+            connections.push_back([&shard = *shards.back()](const Json::Node& request) {
+                return Process(ParseStatRequest(request), shard);
+            });
+        }
+        const Sharding::Coordinator coordinator(regions, move(connections));
+        ASSERT(coordinator.GetBoundaryStopCount() > 0)
+        size_t mismatch_count = 0;
+        for (const auto& from : stops) {
+            const Json::Node request = map<string, Json::Node>{{"type", "Stop"}, {"name", from}, {"id", 1}};
+            if (text(coordinator.Process(request)) != text(expected.GetStop(from, 1))) ++mismatch_count;
+            for (const auto& to : stops) {
+                const Json::Node route_request = map<string, Json::Node>{{"type", "Route"}, {"from", from}, {"to", to}, {"id", 1}};
+                const Json::Node route = coordinator.Process(route_request), expected_route = expected.GetRoute(from, to, 1);
+                if (route.AsMap().count("total_time") != expected_route.AsMap().count("total_time") ||
+                    (route.AsMap().count("total_time") != 0 &&
+                     abs(route.AsMap().at("total_time").AsDouble() - expected_route.AsMap().at("total_time").AsDouble()) > 1e-9)) {
+                    ++mismatch_count;
+                }
+            }
+        }
+        ASSERT_EQUAL(mismatch_count, 0u)
+        for (const string bus : {"297", "635", "828", "none"}) {
+            const Json::Node request = map<string, Json::Node>{{"type", "Bus"}, {"name", bus}, {"id", 1}};
+            ASSERT_EQUAL(text(coordinator.Process(request)), text(expected.GetBus(bus, 1)))
+        }
+        try {
+            coordinator.Process(map<string, Json::Node>{{"type", "Bus"}, {"id", 1}});
+            ASSERT(false)
+        } catch (const Json::SchemaError& error) {
+            ASSERT_EQUAL(error.GetField(), "name")
+        }
+    }
+}
+
+void TestVertexOrder() {
+    using namespace Transport;
+    using namespace Requests;
+    ASSERT_EQUAL(Points::GetHilbertIndex(Points::Point{Points::Latitude(-90), Points::Longitude(-180)}), 0u)
+    const string document = ReadFile("examples/example_2.in");
+    auto expected = BuildDatabase(document), table = BuildDatabase(document, "\"vertex_order\": \"geographic\", "),
+         dijkstra = BuildDatabase(document, "\"vertex_order\": \"geographic\", \"engine\": \"dijkstra\", ");
+    ASSERT_EQUAL(CountRouteMismatches(*expected, *table), 0u)
+    ASSERT_EQUAL(CountRouteMismatches(*expected, *dijkstra), 0u)
+    auto results = Benchmark::BenchmarkVertexOrders(Json::Load(string_view(document)), 10);
+    ASSERT_EQUAL(results.size(), 2u)
+    ASSERT_EQUAL(results[1].vertex_order, "geographic")
+    ASSERT_EQUAL(results[1].route_count, 10u)
+}
+
+void TestRouteCache() {
+    using namespace Transport;
+    using namespace Requests;
+    {
+        RouteCache cache(32);
+        for (size_t i = 0; i < 100; ++i) cache.Insert(i, i + 1, {{"total_time", static_cast<double>(i)}});
+        ASSERT(cache.GetMetrics().size <= 32)
+        ASSERT_EQUAL(cache.Find(99, 100)->at("total_time").AsDouble(), 99.0)
+        ASSERT(!cache.Find(100, 99))
+        ASSERT_EQUAL(cache.GetMetrics().hits, 1u)
+        ASSERT_EQUAL(cache.GetMetrics().misses, 1u)
+        ASSERT(cache.Find(99, 100) == cache.Find(99, 100))
+    }
+    {
+        // the responses themselves are counted
+        RouteCache small(16), large(16);
+        small.Insert(0, 1, {{"items", vector<Json::Node>{}}});
+        large.Insert(0, 1, {{"items", vector<Json::Node>(100, Json::Node(string(100, 'x')))}});
+        ASSERT(large.GetMemoryUsage() >= small.GetMemoryUsage() + 100 * 100)
+    }
+    for (string engine : {"table", "dijkstra"}) {
+        const string document = ReadFile("examples/example_2.in");
+        const string engine_settings = "\"engine\": \"" + engine + "\", ";
+        const auto database = BuildDatabase(document, "\"route_cache_size\": 64, " + engine_settings);
+        const TransportDatabase& tdb = *database;
+        istringstream query_log("{\"type\": \"Route\", \"from\": \"Universam\", \"to\": \"Prazhskaya\", \"id\": 1}\n"
+                                "{\"type\": \"Stop\", \"name\": \"Universam\", \"id\": 2}\n"
+                                "{\"type\": \"Route\", \"from\": \"Universam\", \"to\": \"Apteka\", \"id\": 3}\n");
+        ASSERT_EQUAL(Server::WarmUp(tdb, query_log), 2u)
+        auto metrics = tdb.GetMetrics(7);
+        ASSERT_EQUAL(metrics.AsMap().at("route_cache_size").AsInt(), 2)
+        ASSERT_EQUAL(metrics.AsMap().at("route_cache_misses").AsInt(), 2)
+        ostringstream cached, built;
+        Json::PrintCompact(tdb.GetRoute("Universam", "Prazhskaya", 11), cached);
+        ASSERT_EQUAL(tdb.GetMetrics(7).AsMap().at("route_cache_hits").AsInt(), 1)
+        ASSERT_EQUAL(tdb.GetRoute("Universam", "Rasskazovka", 12).AsMap().at("request_id").AsInt(), 12)
+        const auto uncached = BuildDatabase(document, engine_settings);
+        Json::PrintCompact(uncached->GetRoute("Universam", "Prazhskaya", 11), built);
+        ASSERT_EQUAL(cached.str(), built.str())
+        ASSERT_EQUAL(uncached->GetMetrics(1).AsMap().at("route_cache_misses").AsInt(), 0)
+    }
+}
+
+void TestQueryServer() {
+    using namespace Transport;
+    using namespace Requests;
+    DatabaseSnapshots snapshots(Server::LoadSnapshot("examples/example_1.in"));
+    Server::ServerSettings settings;
+    settings.light_threads = 1;
+    settings.heavy_threads = 2;
+    Server::QueryServer server(snapshots, settings);
+    // a reader that stays on the first version doesn't hold up the Reload reply
+    DatabaseSnapshots::Snapshot slow_reader = snapshots.Acquire();
+    istringstream input("{\"type\": \"Route\", \"from\": \"Biryulyovo Zapadnoye\", \"to\": \"Prazhskaya\", \"id\": 5}\n"
+                        "\n"
+                        "{\"type\": \"Stop\", \"name\": \"Universam\", \"id\": 3}\n"
+                        "{\"type\": \"Tram\", \"id\": 4}\n"
+                        "{\"type\": \"Reload\", \"id\": 6, \"path\": \"examples/example_1.in\"}\n"
+                        "{\"type\": \"Reload\", \"id\": 7, \"path\": \"examples/missing.in\"}\n"
+                        "{\"type\": \"Bus\", \"id\": 8}\n");
+    ostringstream output;
+    server.Serve(input, output);
+    set<string> lines;
+    istringstream output_lines(output.str());
+    for (string line; getline(output_lines, line); ) lines.insert(line);
+    set<string> expected = {
+            "{\"buses\":[\"297\",\"635\"],\"request_id\":3}",
+            "{\"error_message\":\"unknown type of request\",\"request_id\":4}",
+            "{\"request_id\":6,\"version\":2}",
+            "{\"error_message\":\"can't open examples/missing.in\",\"request_id\":7}",
+            "{\"error_message\":\"name: is missing\",\"request_id\":8}",
+            "{\"items\":[{\"stop_name\":\"Biryulyovo Zapadnoye\",\"time\":6,\"type\":\"Wait\"},"
+            "{\"bus\":\"297\",\"span_count\":1,\"time\":3.9,\"type\":\"Bus\"},"
+            "{\"stop_name\":\"Biryulyovo Tovarnaya\",\"time\":6,\"type\":\"Wait\"},"
+            "{\"bus\":\"635\",\"span_count\":2,\"time\":8.31,\"type\":\"Bus\"}],\"request_id\":5,\"total_time\":24.21}"
+    };
+    ASSERT_EQUAL(lines, expected)
+    ASSERT_EQUAL(snapshots.GetRetiredCount(), 1u)
+    slow_reader.reset();
+    ASSERT_EQUAL(snapshots.ReclaimRetired(), 1u)
+}
+
+void TestDatabaseSnapshots() {
+    using namespace Transport;
+    ifstream first_input("examples/example_1.in"), second_input("examples/example_3.in");
+    DatabaseSnapshots snapshots(Server::LoadSnapshot(first_input));
+    DatabaseSnapshots::Snapshot in_flight = snapshots.Acquire();
+    ASSERT_EQUAL(snapshots.Publish(Server::LoadSnapshot(second_input)), 2u)
+    ASSERT_EQUAL(in_flight->GetBus("297", 1).AsMap().at("route_length").AsInt(), 5990)
+    ASSERT(snapshots.Acquire()->GetBus("297", 1).AsMap().count("error_message") != 0)
+    ASSERT_EQUAL(snapshots.ReclaimRetired(), 0u)
+    in_flight.reset();
+    ASSERT_EQUAL(snapshots.ReclaimRetired(), 1u)
+    ASSERT_EQUAL(snapshots.GetRetiredCount(), 0u)
+}
+
+void TestFlatDatabase() {
+    using namespace Transport;
+    for (string example : {"examples/example_1", "examples/example_2", "examples/example_3"}) {
+        ifstream input(example + ".in");
+        Json::Document document = Json::Load(input);
+        TransportDatabase tdb;
+        Requests::ProcessRequests(Requests::ParseBaseRequests(document), tdb);
+        ostringstream image;
+        WriteFlatDatabase(tdb, image);
+        // a copy keeps the image aligned, as a mapping would be
+        const string image_data = image.str();
+        vector<uint64_t> aligned((image_data.size() + 7) / 8);
+        copy(image_data.begin(), image_data.end(), reinterpret_cast<char*>(aligned.data()));
+        FlatDatabaseView view(string_view(reinterpret_cast<const char*>(aligned.data()), image_data.size()));
+        ostringstream output;
+        Json::Print(ProcessStatRequests(document, view), output);
+        ifstream i_expected(example + ".out");
+        string expected;
+        getline(i_expected, expected, '\0');
+        ASSERT_EQUAL(output.str(), expected)
+
+        try {
+            ProcessStatRequests(Json::Load(string_view(R"({"stat_requests": [{"type": "Route", "id": 1, "from": "A"}]})")), view);
+            ASSERT(false)
+        } catch (const Json::SchemaError& error) {
+            ASSERT_EQUAL(error.GetField(), "stat_requests[0].to")
+        }
+
+        // a range running past the end of the image is rejected before anything reads it
+        reinterpret_cast<Flat::Header*>(aligned.data())->edges_offset = (image_data.size() + 7) / 8 * 8;
+        try {
+            FlatDatabaseView broken(string_view(reinterpret_cast<const char*>(aligned.data()), image_data.size()));
+            ASSERT(false)
+        } catch (const invalid_argument&) {
+        }
+    }
+}
+
 void TestAll() {
     TestRunner tr;
     RUN_TEST(tr, TestSvg);
     RUN_TEST(tr, TestReadToken);
     RUN_TEST(tr, TestPoint);
+    RUN_TEST(tr, TestGeoTable);
+    RUN_TEST(tr, TestSpatialIndex);
+    RUN_TEST(tr, TestNameTable);
+    RUN_TEST(tr, TestReachability);
+    RUN_TEST(tr, TestRouteTime);
+    RUN_TEST(tr, TestDeltaStepping);
+    RUN_TEST(tr, TestHubLabels);
+    RUN_TEST(tr, TestOverlay);
     RUN_TEST(tr, TestNode);
     RUN_TEST(tr, TestJson);
+    RUN_TEST(tr, TestJsonSources);
+    RUN_TEST(tr, TestJsonSchema);
+    RUN_TEST(tr, TestParallelFor);
     RUN_TEST(tr, TestExample1);
     RUN_TEST(tr, TestExample2);
     RUN_TEST(tr, TestExample3);
+    RUN_TEST(tr, TestExampleFile);
+    RUN_TEST(tr, TestRequestBatches);
+    RUN_TEST(tr, TestMemoryUsage);
+    RUN_TEST(tr, TestStopQueries);
+    RUN_TEST(tr, TestPointRoute);
+    RUN_TEST(tr, TestMatrix);
+    RUN_TEST(tr, TestReachableStops);
+    RUN_TEST(tr, TestDijkstraEngine);
+    RUN_TEST(tr, TestAltEngine);
+    RUN_TEST(tr, TestRouteBudget);
+    RUN_TEST(tr, TestHubLabelsEngine);
+    RUN_TEST(tr, TestOverlayEngine);
+    RUN_TEST(tr, TestSharding);
+    RUN_TEST(tr, TestVertexOrder);
+    RUN_TEST(tr, TestRouteCache);
+    RUN_TEST(tr, TestQueryServer);
+    RUN_TEST(tr, TestDatabaseSnapshots);
+    RUN_TEST(tr, TestFlatDatabase);
 }
\ No newline at end of file
@@ -1,25 +1,39 @@
 #include "transport.h"
 
 #include <algorithm>
+#include <cmath>
 #include <iomanip>
+#include <limits>
+#include <stdexcept>
 
 namespace Transport {
     BusRoute::BusRoute(Type type, std::vector<StopName> stop_names) : type_(type), stops_names_(std::move(stop_names)) {}
-    void BusRoute::Initialize(const std::unordered_map<StopName, StopHandler>& stop_by_name) {
-        UpdateStopDistances(stop_by_name);
+    namespace {
+        int GetRoadDistance(const Stop& from, const Stop& to) {
+            auto it = from.distance_to_stops.find(to.name);
+            if (it == from.distance_to_stops.end()) throw std::runtime_error("both distances are empty");
+            return it->second;
+        }
+    }
+    void BusRoute::Initialize(const std::unordered_map<StopName, StopHandler>& stop_by_name, const Points::GeoTable& geo_table) {
+        info_ = {};
         info_.num_unique_stops_ = std::set<std::string_view> (stops_names_.cbegin(), stops_names_.cend()).size();
+        std::vector<uint32_t> from_ids, to_ids;
         for (size_t i = 1; i < stops_names_.size(); ++i) {
             StopHandler curr_stop = stop_by_name.at(stops_names_[i]), prev_stop = stop_by_name.at(stops_names_[i - 1]);
-            info_.length_ += Points::CalcLength(prev_stop->location,
-                                                curr_stop->location);
-            info_.road_length_ += prev_stop->distance_to_stops[curr_stop->name];
+            from_ids.push_back(prev_stop->id);
+            to_ids.push_back(curr_stop->id);
+            info_.road_length_ += GetRoadDistance(*prev_stop, *curr_stop);
         }
+        std::vector<double> lengths(from_ids.size());
+        geo_table.CalcLengths(from_ids.data(), to_ids.data(), lengths.size(), lengths.data());
+        for (double length : lengths) info_.length_ += length;
         switch (type_) {
             case Type::Direct:
                 info_.num_stops_ = 2 * stops_names_.size() - 1;
                 for (size_t i = stops_names_.size() - 1; i > 0; --i) {
                     StopHandler curr_stop = stop_by_name.at(stops_names_[i]), prev_stop = stop_by_name.at(stops_names_[i - 1]);
-                    info_.road_length_ += curr_stop->distance_to_stops[prev_stop->name];
+                    info_.road_length_ += GetRoadDistance(*curr_stop, *prev_stop);
                 }
                 info_.length_ *= 2;
                 break;
@@ -45,19 +59,6 @@ namespace Transport {
         return std::tie(info_, stops_names_) == std::tie(other.info_, other.stops_names_);
     }
     BusRouteInfo BusRoute::GetInfo() const { return info_; }
-    void BusRoute::UpdateStopDistances(const std::unordered_map<StopName, StopHandler>& stop_by_name) {
-        for (size_t i = 1; i < stops_names_.size(); ++i) {
-            StopHandler curr_stop = stop_by_name.at(stops_names_[i]), prev_stop = stop_by_name.at(stops_names_[i - 1]);
-            if (curr_stop->distance_to_stops.count(prev_stop->name) == 0 &&
-                prev_stop->distance_to_stops.count(curr_stop->name) == 0) {
-                throw std::runtime_error("both distances are empty");
-            }
-            if (curr_stop->distance_to_stops.count(prev_stop->name) == 0)
-                curr_stop->distance_to_stops[prev_stop->name] = prev_stop->distance_to_stops[curr_stop->name];
-            if (prev_stop->distance_to_stops.count(curr_stop->name) == 0)
-                prev_stop->distance_to_stops[curr_stop->name] = curr_stop->distance_to_stops[prev_stop->name];
-        }
-    }
     const std::vector<StopName>& BusRoute::GetStopNames() const { return stops_names_; }
     bool operator < (const Stop& lhs, const Stop& rhs) {
         return lhs.name < rhs.name;
@@ -89,34 +90,80 @@ namespace Transport {
         return std::tie(lhs.number, lhs.route) == std::tie(rhs.number, rhs.route);
     }
     bool operator == (const RouteSettings& lhs, const RouteSettings& rhs) {
-        return std::tie(lhs.bus_wait_time, lhs.bus_velocity) == std::tie(rhs.bus_wait_time, rhs.bus_velocity);
+        return std::tie(lhs.engine, lhs.bus_wait_time, lhs.bus_velocity, lhs.pedestrian_velocity, lhs.snap_stops_count,
+                        lhs.route_cache_size, lhs.landmark_count, lhs.vertex_order,
+                        lhs.table_algorithm, lhs.overlay_cell_size) ==
+               std::tie(rhs.engine, rhs.bus_wait_time, rhs.bus_velocity, rhs.pedestrian_velocity, rhs.snap_stops_count,
+                        rhs.route_cache_size, rhs.landmark_count, rhs.vertex_order,
+                        rhs.table_algorithm, rhs.overlay_cell_size);
+    }
+    RouteTime ToRouteTime(double minutes) {
+        const double ticks = std::round(minutes * route_time_ticks_per_minute);
+        if (!(ticks >= 0 && ticks <= std::numeric_limits<RouteTime>::max())) {
+            throw std::overflow_error("route time doesn't fit fixed-point weights: " + std::to_string(minutes));
+        }
+        return static_cast<RouteTime>(ticks);
+    }
+    double FromRouteTime(RouteTime time) { return time / route_time_ticks_per_minute; }
+    void RouteResponseBuilder::AddEdge(double weight, std::string_view stop_from, std::optional<std::string_view> bus_to) {
+        result_.total_time += weight;
+        if (bus_to.has_value()) {
+            if (std::holds_alternative<RouteResponse::RouteWaitInfo>(curr_action_)) {
+                result_.actions.emplace_back(RouteResponse::RouteWaitInfo({weight * 2, StopName(stop_from)}));
+                curr_action_ = RouteResponse::RouteBusInfo{0, BusNumber(*bus_to), 0.0};
+            } else {
+                auto& curr_action_ref = std::get<RouteResponse::RouteBusInfo> (curr_action_);
+                if (*bus_to != curr_action_ref.bus_number) throw std::runtime_error("invalid vertex_to.bus");
+                ++curr_action_ref.span_count;
+                curr_action_ref.time += weight;
+            }
+        } else {
+            result_.actions.push_back(curr_action_);
+            curr_action_ = RouteResponse::RouteWaitInfo{0, ""};
+        }
     }
-    Json::Node NodeFromBus(BusHandler bus, size_t request_id) {
+    void RouteResponseBuilder::AddWalk(double time, double distance, std::optional<std::string_view> stop_name) {
+        result_.total_time += time;
+        result_.actions.emplace_back(RouteResponse::RouteWalkInfo{time, distance, stop_name ? std::optional(StopName(*stop_name)) : std::nullopt});
+    }
+    RouteResponse RouteResponseBuilder::Build() && { return std::move(result_); }
+    Json::Node NodeNotFound(size_t request_id) {
+        return std::map<std::string, Json::Node> {{"request_id", static_cast<int>(request_id)},
+                                                  {"error_message", std::string("not found")}};
+    }
+    Json::Node NodeFromBusRouteInfo(const BusRouteInfo& info, size_t request_id) {
         std::map<std::string, Json::Node> node_map;
-        node_map["route_length"] = static_cast<int>(bus->route.GetInfo().road_length_);
+        node_map["route_length"] = static_cast<int>(info.road_length_);
         node_map["request_id"] = static_cast<int>(request_id);
-        node_map["curvature"] = bus->route.GetInfo().curvature_;
-        node_map["stop_count"] = static_cast<int>(bus->route.GetInfo().num_stops_);
-        node_map["unique_stop_count"] = static_cast<int>(bus->route.GetInfo().num_unique_stops_);
+        node_map["curvature"] = info.curvature_;
+        node_map["stop_count"] = static_cast<int>(info.num_stops_);
+        node_map["unique_stop_count"] = static_cast<int>(info.num_unique_stops_);
         return node_map;
     }
+    Json::Node NodeFromBus(BusHandler bus, size_t request_id) {
+        return NodeFromBusRouteInfo(bus->route.GetInfo(), request_id);
+    }
     Json::Node NodeFromStop(StopHandler stop, size_t request_id) {
         std::map<std::string, Json::Node> node_map;
         node_map["request_id"] = static_cast<int>(request_id);
+        node_map["buses"] = NodeFromStopBuses(*stop);
+        return node_map;
+    }
+    Json::Node NodeFromStopBuses(const Stop& stop) {
         std::vector<Json::Node> buses;
-        for (const auto& bus : stop->buses) {
+        for (const auto& bus : stop.buses) {
             buses.emplace_back(bus->number);
         }
         std::sort(buses.begin(), buses.end(), [](const Json::Node& lhs, const Json::Node& rhs){
             return lhs.AsString() < rhs.AsString();
         });
-        node_map["buses"] = buses;
-        return node_map;
+        return buses;
     }
     Json::Node NodeFromRouteResponse(const RouteResponse& route_response, size_t request_id) {
         std::map<std::string, Json::Node> result_map;
         result_map["total_time"] = route_response.total_time;
         result_map["request_id"] = static_cast<int>(request_id);
+        if (!route_response.is_optimal) result_map["is_optimal"] = false;
         std::vector<Json::Node> items;
         for (auto action : route_response.actions) {
             std::map<std::string, Json::Node> curr_node_map;
@@ -125,6 +172,12 @@ namespace Transport {
                 curr_node_map["time"] = action_val.time;
                 curr_node_map["stop_name"] = action_val.stop_name;
                 curr_node_map["type"] = std::string("Wait");
+            } else if (std::holds_alternative<RouteResponse::RouteWalkInfo>(action)) {
+                auto action_val = std::get<RouteResponse::RouteWalkInfo>(action);
+                curr_node_map["time"] = action_val.time;
+                curr_node_map["distance"] = action_val.distance;
+                if (action_val.stop_name) curr_node_map["stop_name"] = *action_val.stop_name;
+                curr_node_map["type"] = std::string("Walk");
             } else {
                 auto action_val = std::get<RouteResponse::RouteBusInfo>(action);
                 curr_node_map["span_count"] = static_cast<int>(action_val.span_count);
@@ -7,13 +7,16 @@
 
 #include "point.h"
 #include "json.h"
+#include <cstdint>
 #include <set>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <iterator>
 #include <tuple>
 #include <unordered_map>
 #include <memory>
+#include <optional>
 
 namespace Transport {
     using BusNumber = std::string;
@@ -23,6 +26,7 @@ namespace Transport {
     using BusHandler = std::shared_ptr<Bus>;
     using StopHandler = std::shared_ptr<Stop>;
     struct Stop {
+        size_t id{0}; // index of the stop in the database, assigned when the database is built
         std::string name;
         Points::Point location;
         std::unordered_map<StopName, int> distance_to_stops;
@@ -43,7 +47,8 @@ namespace Transport {
         } type_;
         BusRoute() = default;
         BusRoute(Type type, std::vector<StopName> stops);
-        void Initialize(const std::unordered_map<StopName, StopHandler>& stop_by_name);
+        // expects symmetrised road distances and only reads the stops, so buses may be initialized concurrently
+        void Initialize(const std::unordered_map<StopName, StopHandler>& stop_by_name, const Points::GeoTable& geo_table);
         friend std::ostream& operator << (std::ostream& output, const BusRoute& BusRoute);
         bool operator == (const BusRoute& other) const;
         BusRouteInfo GetInfo() const;
@@ -51,15 +56,56 @@ namespace Transport {
     private:
         std::vector<StopName> stops_names_;
         BusRouteInfo info_;
-        void UpdateStopDistances(const std::unordered_map<StopName, StopHandler>& stop_by_name);
     };
     struct Bus {
         BusNumber number;
         BusRoute route;
     };
+    // Route graph weights are fixed-point minutes: ticks of 1/10000 minute in 32 bits take half the room of doubles
+    // in graph edges and router entries. Times in responses are recomputed from the exact edge times.
+    using RouteTime = uint32_t;
+    constexpr double route_time_ticks_per_minute = 1e4;
+    RouteTime ToRouteTime(double minutes); // throws std::overflow_error when the time doesn't fit
+    double FromRouteTime(RouteTime time);
     struct RouteSettings {
+        // Table precomputes routes between all stops; Dijkstra searches the graph for every query,
+        // Alt does it with A* guided by landmark distances; HubLabels answers from precomputed hub labels;
+        // Overlay searches cell cliques that are cheap to recompute when the weights change
+        enum class Engine {
+            Table,
+            Dijkstra,
+            Alt,
+            HubLabels,
+            Overlay
+        } engine{Engine::Table};
+        // how the table engine finds the routes from each stop; delta-stepping runs every search on all cores
+        enum class TableAlgorithm {
+            Dijkstra,
+            DeltaStepping
+        } table_algorithm{TableAlgorithm::Dijkstra};
+        size_t landmark_count{8};
+        size_t overlay_cell_size{128}; // most graph vertices in a cell of the overlay engine
         int bus_wait_time{0};
         double bus_velocity{0.0};
+        double pedestrian_velocity{5 * 50. / 3}; // м/мин
+        size_t snap_stops_count{4}; // nearest stops tried at each end of a route between points
+        size_t route_cache_size{0}; // built Route responses kept for repeated stop pairs, 0 disables the cache
+        // Geographic numbers stops and bus routes along a Hilbert curve and sorts edges by their source vertex,
+        // so that a search reads neighbouring vertices and edges from nearby memory
+        enum class VertexOrder {
+            None,
+            Geographic
+        } vertex_order{VertexOrder::None};
+    };
+    // Limits the on-demand search of one Route query by settled vertices or by wall time. A search that runs
+    // out of it answers with the route to the destination found so far, which may be longer than the best one.
+    struct RouteBudget {
+        std::optional<size_t> settled_vertices;
+        std::optional<uint64_t> microseconds;
+    };
+    struct MemorySettings {
+        std::optional<size_t> budget_bytes;
+        bool log_phases{false};
     };
     struct RouteResponse {
         struct RouteWaitInfo {
@@ -71,9 +117,27 @@ namespace Transport {
             BusNumber bus_number;
             double time{0};
         };
-        using Action = std::variant<RouteWaitInfo, RouteBusInfo>;
+        // walk from the origin point to stop_name, or from stop_name to the destination point
+        struct RouteWalkInfo {
+            double time{0};
+            double distance{0};
+            std::optional<StopName> stop_name;
+        };
+        using Action = std::variant<RouteWaitInfo, RouteBusInfo, RouteWalkInfo>;
         double total_time{0};
         std::vector<Action> actions;
+        bool is_optimal{true}; // false for a route found by a search stopped by its budget
+    };
+    // Folds route edges into Wait/Bus actions: an edge into a bus vertex either boards the bus
+    // (the edge keeps half of the wait time) or rides one more span, an edge into a stop vertex alights.
+    class RouteResponseBuilder {
+    public:
+        void AddEdge(double weight, std::string_view stop_from, std::optional<std::string_view> bus_to);
+        void AddWalk(double time, double distance, std::optional<std::string_view> stop_name);
+        RouteResponse Build() &&;
+    private:
+        RouteResponse result_;
+        RouteResponse::Action curr_action_ = RouteResponse::RouteWaitInfo{0, ""};
     };
     std::ostream& operator << (std::ostream& output, const Stop& stop);
     std::ostream& operator << (std::ostream& output, const BusRoute::Type& type);
@@ -82,7 +146,10 @@ namespace Transport {
     bool operator == (const Stop& lhs, const Stop& rhs);
     bool operator == (const Bus& lhs, const Bus& rhs);
     bool operator == (const RouteSettings& lhs, const RouteSettings& rhs);
+    Json::Node NodeNotFound(size_t request_id);
+    Json::Node NodeFromBusRouteInfo(const BusRouteInfo&, size_t request_id);
     Json::Node NodeFromBus(BusHandler, size_t request_id);
     Json::Node NodeFromStop(StopHandler, size_t request_id);
+    Json::Node NodeFromStopBuses(const Stop&);
     Json::Node NodeFromRouteResponse(const RouteResponse&, size_t request_id);
 }
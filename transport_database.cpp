@@ -1,87 +1,677 @@
 #include "transport_database.h"
 #include "utils.h"
+#include "memory_usage.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <limits>
+#include <numeric>
 
 namespace Transport {
+    namespace {
+        // searches run concurrently in server mode, so each thread keeps its own scratch arrays
+        Graph::DijkstraSearch<RouteTime>& GetThreadSearch() {
+            thread_local Graph::DijkstraSearch<RouteTime> search;
+            return search;
+        }
+        Graph::Overlay<RouteTime>::Search& GetThreadOverlaySearch() {
+            thread_local Graph::Overlay<RouteTime>::Search search;
+            return search;
+        }
+        // exact times of the vertices a search settles, written in settle order
+        std::vector<double>& GetThreadExactTimes(size_t vertex_count) {
+            thread_local std::vector<double> times;
+            if (times.size() < vertex_count) times.resize(vertex_count);
+            return times;
+        }
+    }
     void TransportDatabase::AddRoutingSettings(RouteSettings route_settings) { route_settings_ = route_settings; }
+    void TransportDatabase::AddMemorySettings(MemorySettings memory_settings) { memory_settings_ = memory_settings; }
     void TransportDatabase::AddStop(StopHandler stop) { stop_by_name_[stop->name] = stop; }
     void TransportDatabase::AddBus(BusHandler bus) {
-        bus->route.Initialize(stop_by_name_);
         bus_by_number_[bus->number] = bus;
         for (const auto& stop_name : bus->route.GetStopNames()) {
             stop_by_name_[stop_name]->buses.insert(bus);
         }
     }
     Json::Node TransportDatabase::GetBus(const BusNumber& number, size_t request_id) const {
-        if (bus_by_number_.count(number) == 0) return NotFound(request_id);
-        return NodeFromBus(bus_by_number_.at(number), request_id);
+        if (auto index = bus_table_.Find(number)) return NodeFromBus(bus_by_index_[*index], request_id);
+        return NotFound(request_id);
     }
     Json::Node TransportDatabase::GetStop(const StopName& name, size_t request_id) const {
-        if (stop_by_name_.count(name) == 0) return NotFound(request_id);
-        return NodeFromStop(stop_by_name_.at(name), request_id);
+        if (auto id = stop_table_.Find(name)) return NodeFromStop(stop_by_id_[*id], request_id);
+        return NotFound(request_id);
     }
-    Json::Node TransportDatabase::GetRoute(const StopName& from, const StopName& to, size_t request_id) const {
-        std::optional<RouteResponse> route_response = BuildRoute(from, to);
-        if (!route_response) return NotFound(request_id);
-        return NodeFromRouteResponse(*route_response, request_id);
+    std::optional<Graph::VertexId> TransportDatabase::FindStopVertex(std::string_view name) const {
+        if (auto id = stop_table_.Find(name)) return *id;
+        return std::nullopt;
     }
-    void TransportDatabase::InitializeGraph() {
-        size_t vertex_count = stop_by_name_.size();
+    Json::Node TransportDatabase::GetNearestStops(const Points::Point& point, size_t count, size_t request_id) const {
+        return NodeFromFoundStops(spatial_index_.FindNearest(point, count), request_id);
+    }
+    Json::Node TransportDatabase::GetStopsInRadius(const Points::Point& point, double radius, size_t request_id) const {
+        return NodeFromFoundStops(spatial_index_.FindWithinRadius(point, radius), request_id);
+    }
+    Json::Node TransportDatabase::NodeFromFoundStops(const std::vector<Points::SpatialIndex::Found>& found, size_t request_id) const {
+        std::vector<Json::Node> stops;
+        for (const auto& [id, distance] : found) {
+            const Stop& stop = *stop_by_id_[id];
+            stops.emplace_back(std::map<std::string, Json::Node> {{"stop_name", stop.name},
+                                                                  {"distance", distance},
+                                                                  {"buses", NodeFromStopBuses(stop)}});
+        }
+        return std::map<std::string, Json::Node> {{"request_id", static_cast<int>(request_id)}, {"stops", std::move(stops)}};
+    }
+    Json::Node TransportDatabase::GetRoute(const StopName& from, const StopName& to, size_t request_id,
+                                           const RouteBudget& budget) const {
+        const auto from_vertex = FindStopVertex(from), to_vertex = FindStopVertex(to);
+        if (!from_vertex || !to_vertex) return NotFound(request_id);
+        const Graph::VertexId from_id = *from_vertex, to_id = *to_vertex;
+        if (!reachability_->MayReach(from_id, to_id)) return NotFound(request_id);
+        if (auto cached = FindCachedRoute(from_id, to_id, request_id)) return std::move(*cached);
+        if ((budget.settled_vertices || budget.microseconds) && !router_ && !hub_labels_ && !overlay_) {
+            return GetBudgetedRoute(from_id, to_id, request_id, budget);
+        }
+        std::optional<RouteResponse> route_response = BuildRoute(from_id, to_id);
+        Json::Node result = route_response ? NodeFromRouteResponse(*route_response, request_id) : NotFound(request_id);
+        CacheRoute(from_id, to_id, result);
+        return result;
+    }
+    std::optional<Json::Node> TransportDatabase::FindCachedRoute(Graph::VertexId from, Graph::VertexId to, size_t request_id) const {
+        if (!route_cache_) return std::nullopt;
+        std::shared_ptr<const RouteCache::Response> cached = route_cache_->Find(from, to);
+        if (!cached) return std::nullopt;
+        RouteCache::Response response = *cached;
+        response["request_id"] = static_cast<int>(request_id);
+        return Json::Node(std::move(response));
+    }
+    void TransportDatabase::CacheRoute(Graph::VertexId from, Graph::VertexId to, const Json::Node& response) const {
+        if (route_cache_) route_cache_->Insert(from, to, response.AsMap());
+    }
+    Json::Node TransportDatabase::GetMetrics(size_t request_id) const {
+        std::map<std::string, Json::Node> node_map;
+        node_map["request_id"] = static_cast<int>(request_id);
+        RouteCache::Metrics route_cache = route_cache_ ? route_cache_->GetMetrics() : RouteCache::Metrics{};
+        auto to_int = [](uint64_t value) { return static_cast<int>(std::min<uint64_t>(value, std::numeric_limits<int>::max())); };
+        node_map["route_cache_hits"] = to_int(route_cache.hits);
+        node_map["route_cache_misses"] = to_int(route_cache.misses);
+        node_map["route_cache_size"] = to_int(route_cache.size);
+        node_map["route_searches"] = to_int(route_searches_);
+        node_map["settled_vertices"] = to_int(settled_vertices_);
+        node_map["route_budget_exhaustions"] = to_int(route_budget_exhaustions_);
+        node_map["route_budget_unanswered"] = to_int(route_budget_unanswered_);
+        node_map["hub_label_entries"] = to_int(hub_labels_ ? hub_labels_->GetEntryCount() : 0);
+        node_map["hub_labels_build_ms"] = to_int(hub_labels_build_milliseconds_);
+        node_map["hub_label_queries"] = to_int(hub_label_queries_);
+        // mean wall time of a lookup, including the path expansion of Route queries
+        node_map["hub_label_query_ns"] = to_int(hub_label_queries_ != 0 ? hub_label_query_nanoseconds_ / hub_label_queries_ : 0);
+        node_map["overlay_cells"] = to_int(overlay_ ? overlay_->GetCellCount() : 0);
+        node_map["overlay_boundary_vertices"] = to_int(overlay_ ? overlay_->GetBoundaryVertexCount() : 0);
+        node_map["overlay_customization_ms"] = to_int(overlay_customization_milliseconds_);
+        return node_map;
+    }
+    Json::Node TransportDatabase::GetRoute(const Points::Point& from, const Points::Point& to, size_t request_id) const {
+        return NodeFromRouteResponse(BuildRoute(from, to), request_id);
+    }
+    Json::Node TransportDatabase::GetMatrix(const std::vector<StopName>& from, const std::vector<StopName>& to,
+                                            size_t request_id) const {
+        std::vector<Graph::VertexId> from_vertexes, to_vertexes;
+        for (const auto& [names, vertexes] : {std::pair(&from, &from_vertexes), std::pair(&to, &to_vertexes)}) {
+            for (const auto& name : *names) {
+                auto vertex = FindStopVertex(name);
+                if (!vertex) return NotFound(request_id);
+                vertexes->push_back(*vertex);
+            }
+        }
+        std::vector<Json::Node> rows;
+        rows.reserve(from.size());
+        for (const auto& times : BuildMatrix(from_vertexes, to_vertexes)) {
+            std::vector<Json::Node> row;
+            row.reserve(times.size());
+            for (const auto& time : times) {
+                if (time) row.emplace_back(*time);
+                else row.emplace_back(nullptr);
+            }
+            rows.emplace_back(std::move(row));
+        }
+        return std::map<std::string, Json::Node> {{"request_id", static_cast<int>(request_id)}, {"total_times", std::move(rows)}};
+    }
+    Json::Node TransportDatabase::GetReachableStops(const StopName& from, double max_time, size_t request_id) const {
+        auto source = FindStopVertex(from);
+        if (!source) return NotFound(request_id);
+        Graph::DijkstraSearch<RouteTime>& search = GetThreadSearch();
+        search.Start(graph_->GetVertexCount());
+        search.AddSource(*source, 0);
+        // Rounded weights may put a stop at the limit on either side of it, so the search goes further and
+        // the exact times decide. Each edge is rounded by at most half a tick, and a shortest path has fewer
+        // edges than the graph has vertices.
+        const double rounding_slack = FromRouteTime(static_cast<RouteTime>(graph_->GetVertexCount() / 2 + 1));
+        const RouteTime limit = max_time + rounding_slack < FromRouteTime(std::numeric_limits<RouteTime>::max())
+                ? ToRouteTime(max_time + rounding_slack) : std::numeric_limits<RouteTime>::max();
+        // the vertex an edge leaves is settled before the edge's end, so its time is already known
+        std::vector<double>& times = GetThreadExactTimes(graph_->GetVertexCount());
+        std::vector<std::pair<double, Graph::VertexId>> reached;
+        search.Run(*graph_, [&](Graph::VertexId vertex, RouteTime weight) {
+            if (weight > limit) return false;
+            const std::optional<Graph::EdgeId> prev_edge = search.GetPrevEdge(vertex);
+            times[vertex] = prev_edge ? times[graph_->GetEdge(*prev_edge).from] + GetEdgeTime(*prev_edge) : 0.;
+            if (vertex < stop_by_id_.size() && times[vertex] <= max_time) reached.emplace_back(times[vertex], vertex);
+            return true;
+        });
+        std::stable_sort(reached.begin(), reached.end(), [](const auto& lhs, const auto& rhs) { return lhs.first < rhs.first; });
+        std::vector<Json::Node> stops;
+        for (const auto& [time, vertex] : reached) {
+            stops.emplace_back(std::map<std::string, Json::Node> {{"stop_name", stop_by_id_[vertex]->name}, {"time", time}});
+        }
+        return std::map<std::string, Json::Node> {{"request_id", static_cast<int>(request_id)}, {"stops", std::move(stops)}};
+    }
+    std::vector<Json::Node> TransportDatabase::GetRoutes(const StopName& from,
+                                                         const std::vector<std::pair<StopName, size_t>>& to_with_ids) const {
+        // a goal-directed search serves one target, so the alt engine answers the routes one by one
+        if (router_ || landmarks_ || hub_labels_ || overlay_ || to_with_ids.size() == 1) {
+            std::vector<Json::Node> result;
+            for (const auto& [to, request_id] : to_with_ids) result.push_back(GetRoute(from, to, request_id));
+            return result;
+        }
+        std::vector<Json::Node> result(to_with_ids.size());
+        const auto source_vertex = FindStopVertex(from);
+        std::vector<std::optional<Graph::VertexId>> targets(to_with_ids.size());
+        for (size_t i = 0; i < to_with_ids.size(); ++i) targets[i] = FindStopVertex(to_with_ids[i].first);
+        const Graph::VertexId source = source_vertex.value_or(0);
+        std::vector<size_t> misses;
+        std::vector<Graph::VertexId> unique_targets;
+        for (size_t i = 0; i < to_with_ids.size(); ++i) {
+            if (!source_vertex || !targets[i]) {
+                result[i] = NotFound(to_with_ids[i].second);
+                continue;
+            }
+            const Graph::VertexId target = *targets[i];
+            if (!reachability_->MayReach(source, target)) {
+                result[i] = NotFound(to_with_ids[i].second);
+            } else if (auto cached = FindCachedRoute(source, target, to_with_ids[i].second)) {
+                result[i] = std::move(*cached);
+            } else {
+                misses.push_back(i);
+                unique_targets.push_back(target);
+            }
+        }
+        if (misses.empty()) return result;
+        std::sort(unique_targets.begin(), unique_targets.end());
+        unique_targets.erase(std::unique(unique_targets.begin(), unique_targets.end()), unique_targets.end());
+        Graph::DijkstraSearch<RouteTime>& search = GetThreadSearch();
+        search.Start(graph_->GetVertexCount());
+        search.AddSource(source, 0);
+        size_t settled_targets = 0;
+        search.Run(*graph_, [&](Graph::VertexId vertex, RouteTime) {
+            if (std::binary_search(unique_targets.begin(), unique_targets.end(), vertex)) ++settled_targets;
+            return settled_targets < unique_targets.size();
+        });
+        ++route_searches_;
+        settled_vertices_ += search.GetSettledCount();
+        for (size_t i : misses) {
+            const Graph::VertexId target = *targets[i];
+            if (search.IsReached(target)) {
+                RouteResponseBuilder builder;
+                AddPathEdges(GetSearchPath(search, target), builder);
+                result[i] = NodeFromRouteResponse(std::move(builder).Build(), to_with_ids[i].second);
+            } else {
+                result[i] = NotFound(to_with_ids[i].second);
+            }
+            CacheRoute(source, target, result[i]);
+        }
+        return result;
+    }
+    size_t TransportDatabase::MemoryUsage::Total() const {
+        return stop_by_name + bus_by_number + stop_distances + stop_buses +
+               vertex_by_id + graph_edges + graph_incidence_lists + router_routes + spatial_index + route_cache + landmarks +
+               reachability + hub_labels + overlay + name_tables;
+    }
+    TransportDatabase::MemoryUsage TransportDatabase::GetMemoryUsage() const {
+        constexpr size_t shared_control_block = 2 * sizeof(void*);
+        MemoryUsage result;
+        result.stop_by_name = Memory::HeapBytes(stop_by_name_);
+        for (const auto& [_, stop] : stop_by_name_) {
+            result.stop_by_name += sizeof(Stop) + shared_control_block + Memory::HeapBytes(stop->name);
+            result.stop_distances += Memory::HeapBytes(stop->distance_to_stops);
+            result.stop_buses += Memory::HeapBytes(stop->buses);
+        }
+        result.stop_distances += Memory::HeapBytes(derived_road_distances_);
+        result.bus_by_number = Memory::HeapBytes(bus_by_number_);
         for (const auto& [_, bus] : bus_by_number_) {
-            size_t add = bus->route.GetStopNames().size();
-            vertex_count += bus->route.type_ == BusRoute::Type::Direct ? add * 2 : add;
+            result.bus_by_number += sizeof(Bus) + shared_control_block +
+                    Memory::HeapBytes(bus->number) + Memory::HeapBytes(bus->route.GetStopNames());
         }
-        graph_ = std::make_unique<Graph::DirectedWeightedGraph<double>>(vertex_count);
+        result.vertex_by_id = vertex_by_id_.capacity() * sizeof(Vertex);
+        for (const auto& vertex : vertex_by_id_) {
+            result.vertex_by_id += Memory::HeapBytes(vertex.stop_name) + Memory::HeapBytes(vertex.bus);
+        }
+        if (graph_) {
+            result.graph_edges = graph_->GetEdgesMemoryUsage();
+            result.graph_incidence_lists = graph_->GetIncidenceListsMemoryUsage();
+        }
+        if (router_) result.router_routes = router_->GetMemoryUsage();
+        if (route_cache_) result.route_cache = route_cache_->GetMemoryUsage();
+        if (landmarks_) result.landmarks = landmarks_->GetMemoryUsage();
+        if (reachability_) result.reachability = reachability_->GetMemoryUsage();
+        if (hub_labels_) result.hub_labels = hub_labels_->GetMemoryUsage();
+        if (overlay_) result.overlay = overlay_->GetMemoryUsage();
+        result.name_tables = stop_table_.GetMemoryUsage() + bus_table_.GetMemoryUsage() + Memory::HeapBytes(bus_by_index_);
+        result.spatial_index = spatial_index_.GetMemoryUsage() + stop_by_id_.capacity() * sizeof(StopHandler);
+        return result;
     }
-    void TransportDatabase::InitializeRouter() {
-        InitializeGraph();
-        std::vector<Graph::VertexId> abstract_vertexes;
-        size_t vertex_count = 0;
-        for (const auto& [stop_name, _] : stop_by_name_) {
-            abstract_id_by_name_[stop_name] = vertex_count;
-            abstract_vertexes.push_back(vertex_count);
-            vertex_by_id_[vertex_count++] = {stop_name, std::nullopt};
-        }
-        for (const auto& [bus_number, bus] : bus_by_number_) {
-            const std::vector<StopName>& stop_names = bus->route.GetStopNames();
+    Json::Node TransportDatabase::GetMemoryUsage(size_t request_id) const {
+        MemoryUsage memory_usage = GetMemoryUsage();
+        std::map<std::string, Json::Node> node_map;
+        node_map["request_id"] = static_cast<int>(request_id);
+        // Json::Node keeps 32-bit integers, so sizes are reported in kibibytes
+        auto to_kib = [](size_t bytes) { return static_cast<double>(bytes) / 1024; };
+        node_map["stop_by_name_kib"] = to_kib(memory_usage.stop_by_name);
+        node_map["bus_by_number_kib"] = to_kib(memory_usage.bus_by_number);
+        node_map["stop_distances_kib"] = to_kib(memory_usage.stop_distances);
+        node_map["stop_buses_kib"] = to_kib(memory_usage.stop_buses);
+        node_map["vertex_by_id_kib"] = to_kib(memory_usage.vertex_by_id);
+        node_map["graph_edges_kib"] = to_kib(memory_usage.graph_edges);
+        node_map["graph_incidence_lists_kib"] = to_kib(memory_usage.graph_incidence_lists);
+        node_map["router_routes_kib"] = to_kib(memory_usage.router_routes);
+        node_map["spatial_index_kib"] = to_kib(memory_usage.spatial_index);
+        node_map["route_cache_kib"] = to_kib(memory_usage.route_cache);
+        node_map["landmarks_kib"] = to_kib(memory_usage.landmarks);
+        node_map["reachability_kib"] = to_kib(memory_usage.reachability);
+        node_map["hub_labels_kib"] = to_kib(memory_usage.hub_labels);
+        node_map["overlay_kib"] = to_kib(memory_usage.overlay);
+        node_map["name_tables_kib"] = to_kib(memory_usage.name_tables);
+        node_map["total_kib"] = to_kib(memory_usage.Total());
+        return node_map;
+    }
+    void TransportDatabase::CheckMemoryUsage(const std::string& phase, size_t projected_bytes) const {
+        if (!memory_settings_.log_phases && !memory_settings_.budget_bytes) return;
+        MemoryUsage memory_usage = GetMemoryUsage();
+        const size_t total = memory_usage.Total() + projected_bytes;
+        if (memory_settings_.log_phases) {
+            std::ostringstream os;
+            os << "memory after " << phase << ": " << total << " bytes (stop_by_name " << memory_usage.stop_by_name
+               << ", bus_by_number " << memory_usage.bus_by_number << ", stop_distances " << memory_usage.stop_distances
+               << ", stop_buses " << memory_usage.stop_buses << ", vertex_by_id " << memory_usage.vertex_by_id
+               << ", graph_edges " << memory_usage.graph_edges << ", graph_incidence_lists " << memory_usage.graph_incidence_lists
+               << ", router_routes " << memory_usage.router_routes + projected_bytes
+               << ", spatial_index " << memory_usage.spatial_index << ", route_cache " << memory_usage.route_cache
+               << ", landmarks " << memory_usage.landmarks << ", reachability " << memory_usage.reachability
+               << ", hub_labels " << memory_usage.hub_labels << ", overlay " << memory_usage.overlay
+               << ", name_tables " << memory_usage.name_tables << ")" << std::endl;
+            std::cerr << os.str();
+        }
+        if (memory_settings_.budget_bytes && total > *memory_settings_.budget_bytes) {
+            std::ostringstream os;
+            os << "memory budget exceeded after " << phase << ": " << total << " bytes estimated, budget is "
+               << *memory_settings_.budget_bytes << " bytes";
+            throw std::runtime_error(os.str());
+        }
+    }
+    void TransportDatabase::InitializeStops() {
+        geo_table_ = {};
+        geo_table_.Reserve(stop_by_name_.size());
+        stop_by_id_.clear();
+        std::vector<Points::Point> locations;
+        std::vector<StopHandler> stops;
+        for (const auto& [_, stop] : stop_by_name_) stops.push_back(stop);
+        if (route_settings_.vertex_order == RouteSettings::VertexOrder::Geographic) {
+            std::vector<std::pair<uint64_t, StopHandler>> keyed_stops;
+            for (const auto& stop : stops) keyed_stops.emplace_back(Points::GetHilbertIndex(stop->location), stop);
+            std::sort(keyed_stops.begin(), keyed_stops.end(), [](const auto& lhs, const auto& rhs) {
+                return std::tie(lhs.first, lhs.second->name) < std::tie(rhs.first, rhs.second->name);
+            });
+            for (size_t i = 0; i < stops.size(); ++i) stops[i] = keyed_stops[i].second;
+        }
+        for (const auto& stop : stops) {
+            stop->id = geo_table_.Add(stop->location);
+            stop_by_id_.push_back(stop);
+            locations.push_back(stop->location);
+        }
+        spatial_index_ = Points::SpatialIndex(locations);
+    }
+    void TransportDatabase::InitializeNameTables() {
+        std::vector<std::string_view> names;
+        names.reserve(stop_by_id_.size());
+        for (const auto& stop : stop_by_id_) names.push_back(stop->name);
+        stop_table_ = NameTable(names);
+        bus_by_index_.clear();
+        names.clear();
+        for (const auto& [number, bus] : bus_by_number_) {
+            bus_by_index_.push_back(bus);
+            names.push_back(number);
+        }
+        bus_table_ = NameTable(names);
+    }
+    void TransportDatabase::SymmetrizeRoadDistances() {
+        for (const auto& [_, stop] : stop_by_name_) {
+            for (const auto& [stop_name, distance] : stop->distance_to_stops) {
+                auto it = stop_by_name_.find(stop_name);
+                if (it == stop_by_name_.end() || it->second == stop) continue;
+                if (it->second->distance_to_stops.emplace(stop->name, distance).second) {
+                    derived_road_distances_.emplace(stop_name, stop->name);
+                }
+            }
+        }
+    }
+    void TransportDatabase::InitializeBusRoutes() {
+        std::vector<BusHandler> buses;
+        for (const auto& [_, bus] : bus_by_number_) buses.push_back(bus);
+        ParallelFor(buses.size(), [this, &buses](size_t i) { buses[i]->route.Initialize(stop_by_name_, geo_table_); });
+    }
+    void TransportDatabase::InitializeGraph() {
+        std::vector<BusHandler> buses;
+        std::vector<Graph::VertexId> first_vertexes;
+        std::vector<Graph::EdgeId> first_edges;
+        const bool is_geographic = route_settings_.vertex_order == RouteSettings::VertexOrder::Geographic;
+        for (const auto& [_, bus] : bus_by_number_) buses.push_back(bus);
+        if (is_geographic) {
+            // stop ids already follow the curve, a bus goes next to the buses from the same area
+            std::vector<std::pair<size_t, BusHandler>> keyed_buses;
+            for (const auto& bus : buses) {
+                size_t first_stop = stop_by_name_.size();
+                for (const auto& stop_name : bus->route.GetStopNames()) first_stop = std::min(first_stop, stop_by_name_.at(stop_name)->id);
+                keyed_buses.emplace_back(first_stop, bus);
+            }
+            std::sort(keyed_buses.begin(), keyed_buses.end(), [](const auto& lhs, const auto& rhs) {
+                return std::tie(lhs.first, lhs.second->number) < std::tie(rhs.first, rhs.second->number);
+            });
+            for (size_t i = 0; i < buses.size(); ++i) buses[i] = keyed_buses[i].second;
+        }
+        size_t vertex_count = stop_by_name_.size(), edge_count = 0;
+        for (const auto& bus : buses) {
+            first_vertexes.push_back(vertex_count);
+            first_edges.push_back(edge_count);
+            const size_t stop_count = bus->route.GetStopNames().size(), directions = bus->route.type_ == BusRoute::Type::Direct ? 2 : 1;
+            vertex_count += stop_count * directions;
+            if (stop_count != 0) edge_count += (3 * stop_count - 1) * directions;
+        }
+        graph_ = std::make_unique<Graph::DirectedWeightedGraph<RouteTime>>(vertex_count, edge_count);
+        vertex_by_id_.assign(vertex_count, {});
+        for (const auto& stop : stop_by_id_) vertex_by_id_[stop->id] = {stop->name, std::nullopt};
+        ParallelFor(buses.size(), [&](size_t i) {
+            const BusHandler& bus = buses[i];
             std::vector<StopHandler> stops;
-            for (const auto& stop_name : stop_names) stops.push_back(stop_by_name_.at(stop_name));
-            AddBusRouteToGraph(stops.cbegin(), stops.cend(), vertex_count, bus_number);
-            if (bus->route.type_ == BusRoute::Type::Direct)
-                AddBusRouteToGraph(stops.crbegin(), stops.crend(), vertex_count, bus_number);
+            for (const auto& stop_name : bus->route.GetStopNames()) stops.push_back(stop_by_name_.at(stop_name));
+            AddBusRouteToGraph(stops.cbegin(), stops.cend(), first_vertexes[i], first_edges[i], bus->number);
+            if (bus->route.type_ == BusRoute::Type::Direct && !stops.empty()) {
+                AddBusRouteToGraph(stops.crbegin(), stops.crend(), first_vertexes[i] + stops.size(),
+                                   first_edges[i] + 3 * stops.size() - 1, bus->number);
+            }
+        });
+        if (is_geographic) {
+            // the edges of a vertex become one contiguous run
+            std::vector<Graph::Edge<RouteTime>> edges(edge_count);
+            for (Graph::EdgeId edge_id = 0; edge_id < edge_count; ++edge_id) edges[edge_id] = graph_->GetEdge(edge_id);
+            std::stable_sort(edges.begin(), edges.end(), [](const auto& lhs, const auto& rhs) { return lhs.from < rhs.from; });
+            for (Graph::EdgeId edge_id = 0; edge_id < edge_count; ++edge_id) graph_->SetEdge(edge_id, edges[edge_id]);
         }
-        router_ = std::make_unique<Graph::Router<double>>(*graph_, abstract_vertexes);
+        graph_->BuildIncidenceLists();
+    }
+    void TransportDatabase::InitializeRouter() {
+        InitializeStops();
+        InitializeNameTables();
+        SymmetrizeRoadDistances();
+        InitializeBusRoutes();
+        CheckMemoryUsage("database");
+        InitializeGraph();
+        reachability_ = std::make_unique<Graph::Reachability>(*graph_);
+        CheckMemoryUsage("graph");
+        overlay_.reset();
+        InitializeEngine();
+    }
+    void TransportDatabase::CustomizeRoutes(const RouteSettings& route_settings) {
+        if (!graph_) throw std::logic_error("routes are customized after the router is initialized");
+        route_settings_.bus_wait_time = route_settings.bus_wait_time;
+        route_settings_.bus_velocity = route_settings.bus_velocity;
+        SymmetrizeRoadDistances();
+        InitializeBusRoutes();
+        ParallelFor(graph_->GetEdgeCount(), [this](size_t edge_id) {
+            const Graph::Edge<RouteTime>& edge = graph_->GetEdge(edge_id);
+            graph_->SetEdge(edge_id, {edge.from, edge.to, ToRouteTime(GetEdgeTime(edge_id))});
+        });
+        InitializeEngine();
     }
-    Json::Node TransportDatabase::NotFound(size_t request_id) {
-        return std::map<std::string, Json::Node> {{"request_id", static_cast<int>(request_id)},
-                                                  {"error_message", std::string("not found")}};
+    void TransportDatabase::SetRoadDistance(const StopName& from, const StopName& to, int distance) {
+        stop_by_name_.at(from)->distance_to_stops[to] = distance;
+        derived_road_distances_.erase({from, to});
+        if (derived_road_distances_.count({to, from}) != 0) stop_by_name_.at(to)->distance_to_stops[from] = distance;
     }
-    std::optional<RouteResponse> TransportDatabase::BuildRoute(const StopName& from, const StopName& to) const {
-        std::optional<Graph::Router<double>::RouteInfo> route_info = router_->BuildRoute(
-                abstract_id_by_name_.at(from), abstract_id_by_name_.at(to)
-                );
+    void TransportDatabase::InitializeEngine() {
+        route_cache_ = route_settings_.route_cache_size != 0 ? std::make_unique<RouteCache>(route_settings_.route_cache_size) : nullptr;
+        router_.reset();
+        landmarks_.reset();
+        if (route_settings_.engine == RouteSettings::Engine::Alt) {
+            landmarks_ = std::make_unique<Graph::Landmarks<RouteTime>>(*graph_, route_settings_.landmark_count);
+            CheckMemoryUsage("landmarks");
+        }
+        hub_labels_.reset();
+        if (route_settings_.engine == RouteSettings::Engine::HubLabels) {
+            const auto start = std::chrono::steady_clock::now();
+            hub_labels_ = std::make_unique<Graph::HubLabels<RouteTime>>(*graph_);
+            hub_labels_build_milliseconds_ = std::chrono::duration_cast<std::chrono::milliseconds>(
+                    std::chrono::steady_clock::now() - start).count();
+            CheckMemoryUsage("hub labels");
+        }
+        if (route_settings_.engine == RouteSettings::Engine::Overlay) {
+            // the partition depends only on the graph structure and is kept by CustomizeRoutes
+            if (!overlay_) {
+                overlay_ = std::make_unique<Graph::Overlay<RouteTime>>(*graph_, route_settings_.overlay_cell_size);
+            }
+            const auto start = std::chrono::steady_clock::now();
+            overlay_->Customize(*graph_);
+            overlay_customization_milliseconds_ = std::chrono::duration_cast<std::chrono::milliseconds>(
+                    std::chrono::steady_clock::now() - start).count();
+            CheckMemoryUsage("overlay");
+        }
+        if (route_settings_.engine != RouteSettings::Engine::Table) return;
+        std::vector<Graph::VertexId> abstract_vertexes(stop_by_name_.size());
+        std::iota(abstract_vertexes.begin(), abstract_vertexes.end(), 0);
+        size_t route_count = 0;
+        for (Graph::VertexId vertex : abstract_vertexes) route_count += reachability_->CountReachable(vertex);
+        CheckMemoryUsage("router planning", Graph::Router<RouteTime>::EstimateMemoryUsage(
+                graph_->GetVertexCount(), graph_->GetEdgeCount(), route_count));
+        router_ = std::make_unique<Graph::Router<RouteTime>>(*graph_, abstract_vertexes,
+                route_settings_.table_algorithm == RouteSettings::TableAlgorithm::DeltaStepping
+                ? Graph::Router<RouteTime>::Algorithm::DeltaStepping : Graph::Router<RouteTime>::Algorithm::Dijkstra);
+        CheckMemoryUsage("router");
+    }
+    Json::Node TransportDatabase::NotFound(size_t request_id) { return NodeNotFound(request_id); }
+    std::optional<RouteResponse> TransportDatabase::BuildRoute(Graph::VertexId from, Graph::VertexId to) const {
+        if (hub_labels_) {
+            const auto start = std::chrono::steady_clock::now();
+            std::optional<std::vector<Graph::EdgeId>> edges = hub_labels_->GetPath(from, to);
+            ++hub_label_queries_;
+            hub_label_query_nanoseconds_ += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now() - start).count();
+            if (!edges) return std::nullopt;
+            RouteResponseBuilder builder;
+            AddPathEdges(*edges, builder);
+            return std::move(builder).Build();
+        }
+        if (overlay_) {
+            Graph::Overlay<RouteTime>::Search& search = GetThreadOverlaySearch();
+            std::optional<std::vector<Graph::EdgeId>> edges = overlay_->FindRoute(from, to, search);
+            ++route_searches_;
+            settled_vertices_ += search.GetSettledCount();
+            if (!edges) return std::nullopt;
+            RouteResponseBuilder builder;
+            AddPathEdges(*edges, builder);
+            return std::move(builder).Build();
+        }
+        if (!router_) {
+            Graph::DijkstraSearch<RouteTime>& search = GetThreadSearch();
+            SearchRoute(search, from, to, {});
+            if (!search.IsReached(to)) return std::nullopt;
+            RouteResponseBuilder builder;
+            AddPathEdges(GetSearchPath(search, to), builder);
+            return std::move(builder).Build();
+        }
+        std::optional<Graph::Router<RouteTime>::RouteInfo> route_info = router_->BuildRoute(from, to);
         if (!route_info) return std::nullopt;
-        RouteResponse result;
-        RouteResponse::Action curr_action = RouteResponse::RouteWaitInfo{0, ""};
-        for (auto edge_id = 0; edge_id < route_info->edge_count; ++edge_id) {
-            Graph::Edge<double> edge = graph_->GetEdge(router_->GetRouteEdge(route_info->id, edge_id));
-            result.total_time += edge.weight;
+        RouteResponseBuilder builder;
+        for (size_t edge_id = 0; edge_id < route_info->edge_count; ++edge_id) {
+            const Graph::EdgeId route_edge_id = router_->GetRouteEdge(route_info->id, edge_id);
+            const Graph::Edge<RouteTime>& edge = graph_->GetEdge(route_edge_id);
             const Vertex& vertex_from = vertex_by_id_.at(edge.from), vertex_to = vertex_by_id_.at(edge.to);
-            if (vertex_to.bus.has_value()) {
-                if (std::holds_alternative<RouteResponse::RouteWaitInfo>(curr_action)) {
-                    result.actions.emplace_back(RouteResponse::RouteWaitInfo({edge.weight * 2, vertex_from.stop_name}));
-                    curr_action = RouteResponse::RouteBusInfo{0, vertex_to.bus.value(), 0.0};
-                } else {
-                    auto& curr_action_ref = std::get<RouteResponse::RouteBusInfo> (curr_action);
-                    if (vertex_to.bus.value() != curr_action_ref.bus_number) throw std::runtime_error("invalid vertex_to.bus");
-                    ++curr_action_ref.span_count;
-                    curr_action_ref.time += edge.weight;
+            builder.AddEdge(GetEdgeTime(route_edge_id), vertex_from.stop_name, vertex_to.bus);
+        }
+        router_->ReleaseRoute(route_info->id);
+        return std::move(builder).Build();
+    }
+    bool TransportDatabase::SearchRoute(Graph::DijkstraSearch<RouteTime>& search, Graph::VertexId from, Graph::VertexId to,
+                                        const RouteBudget& budget) const {
+        // the clock is read every clock_period settled vertices
+        constexpr size_t clock_period = 64;
+        const auto deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(budget.microseconds.value_or(0));
+        bool is_exhausted = false;
+        auto visitor = [&](Graph::VertexId vertex, RouteTime) {
+            if (vertex == to) return false;
+            const size_t settled_count = search.GetSettledCount();
+            is_exhausted = (budget.settled_vertices && settled_count >= *budget.settled_vertices) ||
+                           (budget.microseconds && settled_count % clock_period == 0 && std::chrono::steady_clock::now() >= deadline);
+            return !is_exhausted;
+        };
+        search.Start(graph_->GetVertexCount());
+        search.AddSource(from, 0);
+        if (landmarks_) {
+            search.Run(*graph_, visitor, [this, to](Graph::VertexId vertex) { return landmarks_->GetLowerBound(vertex, to); });
+        } else {
+            search.Run(*graph_, visitor);
+        }
+        ++route_searches_;
+        settled_vertices_ += search.GetSettledCount();
+        return !is_exhausted;
+    }
+    // A search stopped by its budget answers with the search tree path to the destination if it has reached it:
+    // the path is complete, but a shorter one may be left unsettled. Only complete searches go to the route cache.
+    Json::Node TransportDatabase::GetBudgetedRoute(Graph::VertexId from, Graph::VertexId to, size_t request_id,
+                                                   const RouteBudget& budget) const {
+        Graph::DijkstraSearch<RouteTime>& search = GetThreadSearch();
+        const bool is_complete = SearchRoute(search, from, to, budget);
+        if (!is_complete) ++route_budget_exhaustions_;
+        if (!search.IsReached(to)) {
+            if (is_complete) {
+                Json::Node result = NotFound(request_id);
+                CacheRoute(from, to, result);
+                return result;
+            }
+            ++route_budget_unanswered_;
+            return std::map<std::string, Json::Node> {{"request_id", static_cast<int>(request_id)},
+                                                      {"error_message", std::string("budget exhausted")}};
+        }
+        RouteResponseBuilder builder;
+        AddPathEdges(GetSearchPath(search, to), builder);
+        RouteResponse route_response = std::move(builder).Build();
+        route_response.is_optimal = is_complete;
+        Json::Node result = NodeFromRouteResponse(route_response, request_id);
+        if (is_complete) CacheRoute(from, to, result);
+        return result;
+    }
+    // Snaps both points to their nearest stops and runs one multi-source search from the origin stops,
+    // seeded with their walking times, until no destination stop can improve the best arrival.
+    // Walking the whole way is taken as the initial bound.
+    RouteResponse TransportDatabase::BuildRoute(const Points::Point& from, const Points::Point& to) const {
+        auto walk_time = [this](double distance) { return distance / route_settings_.pedestrian_velocity; };
+        const double direct_distance = Points::CalcLength(from, to);
+        RouteTime best_time = ToRouteTime(walk_time(direct_distance));
+        std::optional<Graph::VertexId> best_target;
+        std::vector<Points::SpatialIndex::Found> origins = spatial_index_.FindNearest(from, route_settings_.snap_stops_count);
+        std::vector<Points::SpatialIndex::Found> targets = spatial_index_.FindNearest(to, route_settings_.snap_stops_count);
+        Graph::DijkstraSearch<RouteTime>& search = GetThreadSearch();
+        search.Start(graph_->GetVertexCount());
+        for (const auto& [id, distance] : origins) search.AddSource(id, ToRouteTime(walk_time(distance)));
+        search.Run(*graph_, [&](Graph::VertexId vertex, RouteTime weight) {
+            if (!(weight < best_time)) return false;
+            for (const auto& [id, distance] : targets) {
+                if (const RouteTime time = Graph::AddWeights(weight, ToRouteTime(walk_time(distance))); id == vertex && time < best_time) {
+                    best_time = time;
+                    best_target = vertex;
                 }
-            } else {
-                result.actions.push_back(curr_action);
-                curr_action = RouteResponse::RouteWaitInfo{0, ""};
             }
+            return true;
+        });
+        RouteResponseBuilder builder;
+        if (!best_target) {
+            builder.AddWalk(walk_time(direct_distance), direct_distance, std::nullopt);
+            return std::move(builder).Build();
         }
-        router_->ReleaseRoute(route_info->id);
+        const std::vector<Graph::EdgeId> edges = GetSearchPath(search, *best_target);
+        const Graph::VertexId origin = edges.empty() ? *best_target : graph_->GetEdge(edges.front()).from;
+        const double origin_distance = Points::CalcLength(from, stop_by_id_[origin]->location);
+        const double target_distance = Points::CalcLength(stop_by_id_[*best_target]->location, to);
+        builder.AddWalk(walk_time(origin_distance), origin_distance, vertex_by_id_[origin].stop_name);
+        AddPathEdges(edges, builder);
+        builder.AddWalk(walk_time(target_distance), target_distance, vertex_by_id_[*best_target].stop_name);
+        return std::move(builder).Build();
+    }
+    std::vector<Graph::EdgeId> TransportDatabase::GetSearchPath(const Graph::DijkstraSearch<RouteTime>& search,
+                                                                Graph::VertexId vertex) const {
+        std::vector<Graph::EdgeId> edges;
+        for (auto edge_id = search.GetPrevEdge(vertex); edge_id; edge_id = search.GetPrevEdge(vertex)) {
+            edges.push_back(*edge_id);
+            vertex = graph_->GetEdge(*edge_id).from;
+        }
+        std::reverse(edges.begin(), edges.end());
+        return edges;
+    }
+    void TransportDatabase::AddPathEdges(const std::vector<Graph::EdgeId>& edges, RouteResponseBuilder& builder) const {
+        for (Graph::EdgeId edge_id : edges) {
+            const Graph::Edge<RouteTime>& edge = graph_->GetEdge(edge_id);
+            builder.AddEdge(GetEdgeTime(edge_id), vertex_by_id_[edge.from].stop_name, vertex_by_id_[edge.to].bus);
+        }
+    }
+    double TransportDatabase::GetEdgeTime(Graph::EdgeId edge_id) const {
+        // the same expressions the graph weights were rounded from
+        const Graph::Edge<RouteTime>& edge = graph_->GetEdge(edge_id);
+        const Vertex& vertex_from = vertex_by_id_[edge.from], & vertex_to = vertex_by_id_[edge.to];
+        if (!vertex_from.bus || !vertex_to.bus) return static_cast<double>(route_settings_.bus_wait_time) / 2;
+        return stop_by_name_.at(vertex_from.stop_name)->distance_to_stops.at(vertex_to.stop_name) / route_settings_.bus_velocity;
+    }
+    double TransportDatabase::GetPathTime(const std::vector<Graph::EdgeId>& edges) const {
+        double time = 0;
+        for (Graph::EdgeId edge_id : edges) time += GetEdgeTime(edge_id);
+        return time;
+    }
+    // One one-to-many search per origin, in parallel; a search stops as soon as every target is settled.
+    std::vector<std::vector<std::optional<double>>> TransportDatabase::BuildMatrix(const std::vector<Graph::VertexId>& from,
+                                                                                   const std::vector<Graph::VertexId>& to) const {
+        std::vector<Graph::VertexId> unique_to = to;
+        std::sort(unique_to.begin(), unique_to.end());
+        unique_to.erase(std::unique(unique_to.begin(), unique_to.end()), unique_to.end());
+        std::vector<std::vector<std::optional<double>>> result(from.size());
+        if (hub_labels_) {
+            // label distances are the rounded graph weights, the paths are not expanded
+            const auto start = std::chrono::steady_clock::now();
+            ParallelFor(from.size(), [&](size_t i) {
+                result[i].assign(to.size(), std::nullopt);
+                for (size_t j = 0; j < to.size(); ++j) {
+                    if (auto weight = hub_labels_->GetWeight(from[i], to[j])) result[i][j] = FromRouteTime(*weight);
+                }
+            });
+            hub_label_queries_ += from.size() * to.size();
+            hub_label_query_nanoseconds_ += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now() - start).count();
+            return result;
+        }
+        ParallelFor(from.size(), [&](size_t i) {
+            result[i].assign(to.size(), std::nullopt);
+            // targets in components the origin can't reach would only make the search exhaust the graph
+            const size_t target_count = std::count_if(unique_to.begin(), unique_to.end(), [&](Graph::VertexId vertex) {
+                return reachability_->MayReach(from[i], vertex);
+            });
+            if (target_count == 0) return;
+            Graph::DijkstraSearch<RouteTime>& search = GetThreadSearch();
+            search.Start(graph_->GetVertexCount());
+            search.AddSource(from[i], 0);
+            size_t settled_targets = 0;
+            search.Run(*graph_, [&](Graph::VertexId vertex, RouteTime) {
+                if (std::binary_search(unique_to.begin(), unique_to.end(), vertex)) ++settled_targets;
+                return settled_targets < target_count;
+            });
+            for (size_t j = 0; j < to.size(); ++j) {
+                if (search.IsReached(to[j])) result[i][j] = GetPathTime(GetSearchPath(search, to[j]));
+            }
+        });
         return result;
     }
-}
\ No newline at end of file
+}
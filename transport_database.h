@@ -6,8 +6,10 @@
 #endif //CPPCOURSERA_TRANSPORT_DIRECTORY_H
 
 #include "point.h"
+#include <atomic>
 #include <iostream>
 #include <memory>
+#include <set>
 #include <string>
 #include <sstream>
 #include <variant>
@@ -18,44 +20,129 @@
 #include "transport.h"
 #include "json.h"
 #include "router.h"
+#include "graph_search.h"
+#include "hub_labels.h"
+#include "landmarks.h"
+#include "overlay.h"
+#include "reachability.h"
+#include "spatial_index.h"
+#include "route_cache.h"
+#include "name_table.h"
 
 namespace Transport {
     class TransportDatabase {
     public:
+        struct MemoryUsage {
+            size_t stop_by_name{0}, bus_by_number{0}, stop_distances{0}, stop_buses{0};
+            size_t vertex_by_id{0}, graph_edges{0}, graph_incidence_lists{0}, router_routes{0}, spatial_index{0};
+            size_t route_cache{0}, landmarks{0}, reachability{0}, hub_labels{0}, overlay{0}, name_tables{0};
+            size_t Total() const;
+        };
         void AddRoutingSettings(RouteSettings route_settings);
+        void AddMemorySettings(MemorySettings memory_settings);
         void AddStop(StopHandler stop);
         void AddBus(BusHandler bus);
         Json::Node GetBus(const BusNumber& number, size_t request_id) const;
         Json::Node GetStop(const StopName& name, size_t request_id) const;
-        Json::Node GetRoute(const StopName& from, const StopName& to, size_t request_id) const;
+        // the budget limits the dijkstra and alt engines, the other engines answer from precomputed structures
+        Json::Node GetRoute(const StopName& from, const StopName& to, size_t request_id, const RouteBudget& budget = {}) const;
+        Json::Node GetRoute(const Points::Point& from, const Points::Point& to, size_t request_id) const;
+        // answers several routes from one stop; the Dijkstra engine serves them all from a single search
+        std::vector<Json::Node> GetRoutes(const StopName& from, const std::vector<std::pair<StopName, size_t>>& to_with_ids) const;
+        // total_time for every pair, a row per origin; null for unreachable pairs
+        Json::Node GetMatrix(const std::vector<StopName>& from, const std::vector<StopName>& to, size_t request_id) const;
+        // stops whose arrival time from the stop is within max_time, in order of arrival
+        Json::Node GetReachableStops(const StopName& from, double max_time, size_t request_id) const;
+        Json::Node GetNearestStops(const Points::Point& point, size_t count, size_t request_id) const;
+        Json::Node GetStopsInRadius(const Points::Point& point, double radius, size_t request_id) const;
+        Json::Node GetMemoryUsage(size_t request_id) const;
+        // counters of the running database: route cache hits and misses, on-demand route searches
+        // and the vertices they settled, searches stopped by their budget and those of them left without a route,
+        // hub label size, build time and lookups, overlay cells and customization time
+        Json::Node GetMetrics(size_t request_id) const;
+        MemoryUsage GetMemoryUsage() const;
         void InitializeRouter();
+        // Applies new bus_wait_time and bus_velocity of route_settings, the rest of it is ignored, and the road
+        // distances changed by SetRoadDistance to a built database. The graph keeps its structure and only
+        // gets new weights; the overlay engine recomputes its cell cliques, other engines are rebuilt.
+        void CustomizeRoutes(const RouteSettings& route_settings);
+        // the road distance from one stop to another, taken into account by the next CustomizeRoutes;
+        // a reverse distance that was not declared follows it
+        void SetRoadDistance(const StopName& from, const StopName& to, int distance);
+        friend void WriteFlatDatabase(const TransportDatabase& tdb, std::ostream& output);
     private:
         struct Vertex {
             StopName stop_name;
             std::optional<BusNumber> bus;
         };
-        std::unique_ptr<Graph::Router<double>> router_;
-        std::unique_ptr<Graph::DirectedWeightedGraph<double>> graph_;
+        std::unique_ptr<Graph::Router<RouteTime>> router_;
+        std::unique_ptr<Graph::DirectedWeightedGraph<RouteTime>> graph_;
+        std::unique_ptr<RouteCache> route_cache_;
+        std::unique_ptr<Graph::Landmarks<RouteTime>> landmarks_;
+        std::unique_ptr<Graph::Reachability> reachability_;
+        std::unique_ptr<Graph::HubLabels<RouteTime>> hub_labels_;
+        uint64_t hub_labels_build_milliseconds_{0};
+        std::unique_ptr<Graph::Overlay<RouteTime>> overlay_;
+        uint64_t overlay_customization_milliseconds_{0};
+        mutable std::atomic<uint64_t> route_searches_{0}, settled_vertices_{0};
+        mutable std::atomic<uint64_t> route_budget_exhaustions_{0}, route_budget_unanswered_{0};
+        mutable std::atomic<uint64_t> hub_label_queries_{0}, hub_label_query_nanoseconds_{0};
         RouteSettings route_settings_;
+        MemorySettings memory_settings_;
         std::unordered_map<StopName, StopHandler> stop_by_name_;
         std::unordered_map<BusNumber, BusHandler> bus_by_number_;
-        std::unordered_map<StopName, Graph::VertexId> abstract_id_by_name_;
-        std::unordered_map<Graph::VertexId, Vertex> vertex_by_id_;
+        // (from, to) of the road distances copied from the opposite direction by SymmetrizeRoadDistances
+        std::set<std::pair<StopName, StopName>> derived_road_distances_;
+        // queries find stops and buses by name in these tables, built with the router; a stop's position is its id
+        NameTable stop_table_, bus_table_;
+        std::vector<BusHandler> bus_by_index_;
+        std::vector<Vertex> vertex_by_id_;
+        Points::GeoTable geo_table_;
+        std::vector<StopHandler> stop_by_id_;
+        Points::SpatialIndex spatial_index_;
         static Json::Node NotFound(size_t request_id);
+        Json::Node NodeFromFoundStops(const std::vector<Points::SpatialIndex::Found>& found, size_t request_id) const;
+        void CheckMemoryUsage(const std::string& phase, size_t projected_bytes = 0) const;
+        void InitializeStops();
+        void InitializeNameTables();
+        // the stop vertex of the graph, its id
+        std::optional<Graph::VertexId> FindStopVertex(std::string_view name) const;
+        void SymmetrizeRoadDistances();
+        void InitializeBusRoutes();
         void InitializeGraph();
-        std::optional<RouteResponse> BuildRoute(const StopName& from, const StopName& to) const;
+        // the structures of the routing engine for the current graph weights
+        void InitializeEngine();
+        std::optional<RouteResponse> BuildRoute(Graph::VertexId from, Graph::VertexId to) const;
+        // the on-demand search from one vertex towards another; false when the budget ran out before the target was settled
+        bool SearchRoute(Graph::DijkstraSearch<RouteTime>& search, Graph::VertexId from, Graph::VertexId to,
+                         const RouteBudget& budget) const;
+        Json::Node GetBudgetedRoute(Graph::VertexId from, Graph::VertexId to, size_t request_id, const RouteBudget& budget) const;
+        std::optional<Json::Node> FindCachedRoute(Graph::VertexId from, Graph::VertexId to, size_t request_id) const;
+        void CacheRoute(Graph::VertexId from, Graph::VertexId to, const Json::Node& response) const;
+        RouteResponse BuildRoute(const Points::Point& from, const Points::Point& to) const;
+        // edges of the search tree path ending at vertex, in travel order
+        std::vector<Graph::EdgeId> GetSearchPath(const Graph::DijkstraSearch<RouteTime>& search, Graph::VertexId vertex) const;
+        // graph weights are rounded, responses sum the exact edge times in travel order
+        double GetEdgeTime(Graph::EdgeId edge_id) const;
+        double GetPathTime(const std::vector<Graph::EdgeId>& edges) const;
+        void AddPathEdges(const std::vector<Graph::EdgeId>& edges, RouteResponseBuilder& builder) const;
+        std::vector<std::vector<std::optional<double>>> BuildMatrix(const std::vector<Graph::VertexId>& from,
+                                                                    const std::vector<Graph::VertexId>& to) const;
+        // writes the vertices and edges of one bus direction into its own pre-sized ranges
         template <typename RandomIt>
-        void AddBusRouteToGraph(RandomIt begin, RandomIt end, size_t& vertex_count, const BusNumber& bus_number) {
+        void AddBusRouteToGraph(RandomIt begin, RandomIt end, Graph::VertexId first_vertex, Graph::EdgeId first_edge,
+                                const BusNumber& bus_number) {
             for (RandomIt it = begin; it != end; ++it) {
-                Graph::VertexId abstract_stop = abstract_id_by_name_.at((*it)->name);
-                Graph::VertexId curr_stop = vertex_count++;
+                Graph::VertexId abstract_stop = (*it)->id;
+                Graph::VertexId curr_stop = first_vertex++;
                 vertex_by_id_[curr_stop] = {(*it)->name, bus_number};
-                graph_->AddEdge({abstract_stop, curr_stop, static_cast<double>(route_settings_.bus_wait_time) / 2});
-                graph_->AddEdge({curr_stop, abstract_stop, static_cast<double>(route_settings_.bus_wait_time) / 2});
+                const RouteTime half_wait_time = ToRouteTime(static_cast<double>(route_settings_.bus_wait_time) / 2);
+                graph_->SetEdge(first_edge++, {abstract_stop, curr_stop, half_wait_time});
+                graph_->SetEdge(first_edge++, {curr_stop, abstract_stop, half_wait_time});
                 if (it != begin) {
-                    Graph::VertexId prev_stop = vertex_count - 2;
+                    Graph::VertexId prev_stop = curr_stop - 1;
                     double forward_time = (*std::prev(it))->distance_to_stops.at((*it)->name) / route_settings_.bus_velocity;
-                    graph_->AddEdge({prev_stop, curr_stop, forward_time});
+                    graph_->SetEdge(first_edge++, {prev_stop, curr_stop, ToRouteTime(forward_time)});
                 }
             }
         }